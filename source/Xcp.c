@@ -21,30 +21,127 @@
 #include "Xcp_Internal.h"
 #include "Xcp_ByteStream.h"
 #include <string.h>
-#include <stdlib.h>
 
 
-Xcp_BufferType Xcp_Buffers[XCP_MAX_RXTX_QUEUE];
-Xcp_FifoType   Xcp_FifoFree;
-Xcp_FifoType   Xcp_FifoRx = { .free = &Xcp_FifoFree };
-Xcp_FifoType   Xcp_FifoTx = { .free = &Xcp_FifoFree };
+/* buffer data is kept in word sized slots, large buffers first */
+#define XCP_BUFFER_SLOT(size) ((XCP_TX_HEADROOM + (size) + sizeof(uint32) - 1) / sizeof(uint32))
+
+static uint32  Xcp_BufferLarge [XCP_BUFFER_LARGE_COUNT ][XCP_BUFFER_SLOT(XCP_MAX_DTO)];
+#if(XCP_BUFFER_MEDIUM_COUNT)
+static uint32  Xcp_BufferMedium[XCP_BUFFER_MEDIUM_COUNT][XCP_BUFFER_SLOT(XCP_BUFFER_MEDIUM_SIZE)];
+#endif
+#if(XCP_BUFFER_SMALL_COUNT)
+static uint32  Xcp_BufferSmall [XCP_BUFFER_SMALL_COUNT ][XCP_BUFFER_SLOT(XCP_BUFFER_SMALL_SIZE)];
+#endif
 
-       int                 Xcp_Connected;
+Xcp_BufferType Xcp_Buffers[XCP_MAX_RXTX_QUEUE];
+Xcp_FifoType   Xcp_FifoFree       = { .free = NULL               , .size = XCP_MAX_DTO };
+Xcp_FifoType   Xcp_FifoFreeMedium = { .free = &Xcp_FifoFree      , .size = XCP_BUFFER_MEDIUM_SIZE };
+Xcp_FifoType   Xcp_FifoFreeSmall  = { .free = &Xcp_FifoFreeMedium, .size = XCP_BUFFER_SMALL_SIZE };
+Xcp_FifoType   Xcp_FifoFreeCto  = { .free = &Xcp_FifoFreeSmall, .size = XCP_MAX_DTO };
+Xcp_FifoType   Xcp_FifoFreeRx   = { .free = &Xcp_FifoFreeSmall, .size = XCP_MAX_DTO };
+Xcp_FifoType   Xcp_FifoFreeStim = { .free = &Xcp_FifoFreeSmall, .size = XCP_MAX_DTO };
+Xcp_FifoType   Xcp_FifoFreeDaq  = { .free = &Xcp_FifoFreeSmall, .size = XCP_MAX_DTO };
+
+       Xcp_SessionType     Xcp_Sessions[XCP_MAX_TRANSPORTS];
+       uint8               Xcp_SessionCount;
+       Xcp_SessionType*    Xcp_Session;
        int                 Xcp_Inited;
 
-static Xcp_TransferType    Xcp_Download;
 static Xcp_DaqPtrStateType Xcp_DaqState;
-static Xcp_TransferType    Xcp_Upload;
-static Xcp_CmdWorkType     Xcp_Worker;
 
-#if(XCP_FEATURE_PROTECTION)
-static Xcp_UnlockType      Xcp_Unlock;
+/** transports served when none are given in configuration */
+static const Xcp_TransportType* const Xcp_TransportDefault[] = {
+#if(XCP_TRANSPORT_CAN == STD_ON)
+    &Xcp_TransportCan,
 #endif
+#if(XCP_TRANSPORT_ETH != STD_OFF)
+    &Xcp_TransportEth,
+#endif
+};
 
-       Xcp_MtaType         Xcp_Mta;
        Xcp_ConfigType      Xcp_Config;
 const  Xcp_ConfigType*     Xcp_ConfigOriginal;
 
+#if(XCP_FEATURE_DAQSTIM_DYNAMIC)
+static Xcp_DaqListType*    Xcp_DaqDynamic; /**< contigous block of dynamically allocated daq lists */
+
+static union {
+    uint8    data[XCP_DAQ_ARENA_SIZE];
+    intptr_t align;
+}                          Xcp_DaqArena;      /**< memory for dynamic daq configuration */
+static size_t              Xcp_DaqArenaUsed;  /**< bytes used of Xcp_DaqArena */
+
+/**
+ * Bytes of the arena an allocation takes, including alignment
+ * @param count number of elements
+ * @param size size of each element
+ */
+static size_t Xcp_DaqAllocSize(size_t count, size_t size)
+{
+    return (count * size + sizeof(intptr_t) - 1) & ~(sizeof(intptr_t) - 1);
+}
+#endif
+
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+static Xcp_DaqListType*    Xcp_DaqPid[0xFC]; /**< daq list owning each absolute pid */
+#endif
+
+static void Xcp_DaqCompile(Xcp_DaqListType* daq);
+#if(XCP_FEATURE_CALPAG)
+static void Xcp_SegmentEcuPage(Xcp_SegmentType* seg);
+#endif
+
+/**
+ * Find daq list by number. Predefined and dynamic daq
+ * lists are each stored as contigous arrays.
+ * @param daqNr
+ * @return daq list or NULL if out of range
+ */
+static Xcp_DaqListType* Xcp_GetDaq(uint16 daqNr)
+{
+    if(daqNr >= Xcp_Config.XcpMaxDaq)
+        return NULL;
+#if(XCP_FEATURE_DAQSTIM_DYNAMIC)
+    if(Xcp_DaqDynamic && daqNr >= Xcp_Config.XcpMinDaq)
+        return Xcp_DaqDynamic + (daqNr - Xcp_Config.XcpMinDaq);
+#endif
+    return Xcp_Config.XcpDaqList + daqNr;
+}
+
+/**
+ * Find the session DTO packets of a daq list are sent on.
+ * Lists routed to a transport that is not registered use the first.
+ * @param daq
+ * @return session
+ */
+static Xcp_SessionType* Xcp_DaqSession(const Xcp_DaqListType* daq)
+{
+    if(daq->XcpParams.Transport < Xcp_SessionCount)
+        return Xcp_Sessions + daq->XcpParams.Transport;
+    return Xcp_Sessions;
+}
+
+/**
+ * Number odt's of all daq lists with consecutive pid's and
+ * rebuild the pid index, when using absolute identification.
+ */
+static void Xcp_DaqIndexPid(void)
+{
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+    unsigned pid = 0;
+    memset(Xcp_DaqPid, 0, sizeof(Xcp_DaqPid));
+    for(uint16 d = 0; d < Xcp_Config.XcpMaxDaq; d++) {
+        Xcp_DaqListType* daq = Xcp_GetDaq(d);
+        for(int o = 0; o < daq->XcpMaxOdt; o++, pid++) {
+            daq->XcpOdt[o].XcpOdt2DtoMapping.XcpDtoPid = pid;
+            if(pid < sizeof(Xcp_DaqPid) / sizeof(Xcp_DaqPid[0]))
+                Xcp_DaqPid[pid] = daq;
+        }
+    }
+#endif
+}
+
 /**
  * Initializing function
  *
@@ -64,12 +161,84 @@ void Xcp_Init(const Xcp_ConfigType* Xcp_ConfigPtr)
     Xcp_ConfigOriginal = Xcp_ConfigPtr;
     memcpy(&Xcp_Config, Xcp_ConfigPtr, sizeof(Xcp_Config));
 
-    Xcp_Fifo_Init(&Xcp_FifoFree, Xcp_Buffers, Xcp_Buffers+sizeof(Xcp_Buffers)/sizeof(Xcp_Buffers[0]));
+    /* attach data to buffers, ordered large, medium, small */
+    Xcp_BufferType* b = Xcp_Buffers;
+    for(int i = 0; i < XCP_BUFFER_LARGE_COUNT; i++) {
+        (b++)->data = (uint8*)Xcp_BufferLarge[i] + XCP_TX_HEADROOM;
+    }
+#if(XCP_BUFFER_MEDIUM_COUNT)
+    for(int i = 0; i < XCP_BUFFER_MEDIUM_COUNT; i++) {
+        (b++)->data = (uint8*)Xcp_BufferMedium[i] + XCP_TX_HEADROOM;
+    }
+#endif
+#if(XCP_BUFFER_SMALL_COUNT)
+    for(int i = 0; i < XCP_BUFFER_SMALL_COUNT; i++) {
+        (b++)->data = (uint8*)Xcp_BufferSmall[i] + XCP_TX_HEADROOM;
+    }
+#endif
+
+    /* reserve large buffers for each traffic class, rest is shared */
+    b = Xcp_Buffers;
+    Xcp_Fifo_Init(&Xcp_FifoFreeCto , b, b + XCP_POOL_CTO);
+    b += XCP_POOL_CTO;
+    Xcp_Fifo_Init(&Xcp_FifoFreeRx  , b, b + XCP_POOL_RX);
+    b += XCP_POOL_RX;
+    Xcp_Fifo_Init(&Xcp_FifoFreeStim, b, b + XCP_POOL_STIM);
+    b += XCP_POOL_STIM;
+    Xcp_Fifo_Init(&Xcp_FifoFreeDaq , b, b + XCP_POOL_DAQ);
+    b += XCP_POOL_DAQ;
+    Xcp_Fifo_Init(&Xcp_FifoFree    , b, Xcp_Buffers + XCP_BUFFER_LARGE_COUNT);
+    b = Xcp_Buffers + XCP_BUFFER_LARGE_COUNT;
+    Xcp_Fifo_Init(&Xcp_FifoFreeMedium, b, b + XCP_BUFFER_MEDIUM_COUNT);
+    b += XCP_BUFFER_MEDIUM_COUNT;
+    Xcp_Fifo_Init(&Xcp_FifoFreeSmall , b, b + XCP_BUFFER_SMALL_COUNT);
+
+    /* each transport is served as a session of its own, sharing the buffer pools */
+    const Xcp_TransportType* const* transport = Xcp_Config.XcpTransport;
+    Xcp_SessionCount = Xcp_Config.XcpTransportCount;
+    if(Xcp_SessionCount == 0) {
+        transport        = Xcp_TransportDefault;
+        Xcp_SessionCount = sizeof(Xcp_TransportDefault) / sizeof(Xcp_TransportDefault[0]);
+    }
+    DET_VALIDATE_NRV(Xcp_SessionCount <= XCP_MAX_TRANSPORTS, 0x00, XCP_E_INIT_FAILED);
+
+    memset(Xcp_Sessions, 0, sizeof(Xcp_Sessions));
+    for(int t = 0; t < Xcp_SessionCount; t++) {
+        Xcp_SessionType* s = Xcp_Sessions + t;
+        s->transport = transport[t];
+        s->rx.free   = &Xcp_FifoFreeRx;
+        s->tx.free   = &Xcp_FifoFreeCto;
+        Xcp_Fifo_Init(&s->rx, NULL, NULL);
+        Xcp_Fifo_Init(&s->tx, NULL, NULL);
+        for(int p = 0; p < XCP_DAQ_PRIORITY_QUEUES; p++) {
+            s->daq[p].free = &Xcp_FifoFreeDaq;
+            Xcp_Fifo_Init(&s->daq[p], NULL, NULL);
+        }
+#if(XCP_TX_RATE_BYTES)
+        s->tx_tokens = XCP_TX_RATE_BURST;
+#endif
+    }
+    Xcp_Session = Xcp_Sessions;
 
     if(Xcp_Config.XcpMaxDaq == 0) {
         Xcp_Config.XcpMaxDaq = Xcp_Config.XcpMinDaq;
     }
 
+#if(XCP_FEATURE_DAQSTIM_DYNAMIC)
+    Xcp_DaqDynamic   = NULL;
+    Xcp_DaqArenaUsed = 0;
+#endif
+
+    /* drop lists a previous init left assigned to the event channels */
+    for(int i = 0; i < Xcp_Config.XcpMaxEventChannel; i++) {
+        Xcp_EventChannelType* ech = Xcp_Config.XcpEventChannel + i;
+        DET_VALIDATE_NRV(ech->XcpEventChannelStaging
+                      || !(ech->XcpEventChannelProperties & (XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_DAQ
+                                                           | XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_EVENT))
+                      , 0x00, XCP_E_INIT_FAILED);
+        ech->XcpEventChannelDaqCount = 0;
+    }
+
     unsigned pid = 0;
 
 	for(int daqNr = 0; daqNr < Xcp_Config.XcpMaxDaq; daqNr++) {
@@ -110,21 +279,44 @@ void Xcp_Init(const Xcp_ConfigType* Xcp_ConfigPtr)
             }
         }
 
+        Xcp_DaqCompile(daq);
     }
 
+    Xcp_DaqIndexPid();
+
+#if(XCP_FEATURE_CALPAG)
+    for(uint16 i = 0; i < Xcp_Config.XcpMaxSegment; i++) {
+        Xcp_SegmentEcuPage(Xcp_Config.XcpSegment + i);
+    }
+#endif
     Xcp_Inited = 1;
 }
 
+/**
+ * Find the session serving a transport
+ * @param transport
+ * @return session or NULL if transport is not registered
+ */
+Xcp_SessionType* Xcp_GetSession(const Xcp_TransportType* transport)
+{
+    for(int t = 0; t < Xcp_SessionCount; t++) {
+        if(Xcp_Sessions[t].transport == transport)
+            return Xcp_Sessions + t;
+    }
+    return NULL;
+}
+
 /**
  * Function called from lower layers (CAN/Ethernet..) containing
  * a received XCP packet.
  *
  * Can be called in interrupt context.
  *
+ * @param transport transport packet was received on
  * @param data
  * @param len
  */
-void Xcp_RxIndication(const void* data, int len)
+void Xcp_RxIndication(const Xcp_TransportType* transport, const void* data, int len)
 {
     if(len > XCP_MAX_DTO) {
         DEBUG(DEBUG_HIGH, "Xcp_RxIndication - length %d too long\n", len);
@@ -134,10 +326,64 @@ void Xcp_RxIndication(const void* data, int len)
     if(len == 0)
         return;
 
-    FIFO_GET_WRITE(Xcp_FifoRx, it) {
+    Xcp_BufferType* it = Xcp_RxBorrow(transport, GET_UINT8(data, 0), len);
+    if(it) {
         memcpy(it->data, data, len);
         it->len = len;
+        Xcp_RxCommit(transport, it);
+    }
+}
+
+/**
+ * Borrow an empty buffer to receive a packet into, letting
+ * the transport fill it without an intermediate copy. The
+ * buffer must be handed back with Xcp_RxCommit or Xcp_RxRelease.
+ *
+ * @param transport transport packet is received on
+ * @param pid first byte of packet, selects the buffer pool
+ * @param size length of packet, selects the buffer size class
+ * @return buffer or NULL if no buffer is available
+ */
+Xcp_BufferType* Xcp_RxBorrow(const Xcp_TransportType* transport, uint8 pid, unsigned int size)
+{
+    if(Xcp_GetSession(transport) == NULL) {
+        return NULL;
+    }
+
+    Xcp_FifoType* pool = &Xcp_FifoFreeRx;
+    if(pid <= XCP_PID_CMD_STIM_LAST) {
+        pool = &Xcp_FifoFreeStim;
+    }
+
+    Xcp_BufferType* it = Xcp_Fifo_Alloc(pool, size);
+    if(it) {
+        it->len = 0;
     }
+    return it;
+}
+
+/**
+ * Queue a filled buffer from Xcp_RxBorrow for processing
+ * @param transport transport packet was received on
+ * @param buf buffer with data and len set
+ */
+void Xcp_RxCommit(const Xcp_TransportType* transport, Xcp_BufferType* buf)
+{
+    Xcp_SessionType* session = Xcp_GetSession(transport);
+    if(session == NULL || buf->len == 0 || buf->len > XCP_MAX_DTO) {
+        Xcp_RxRelease(buf);
+        return;
+    }
+    Xcp_Fifo_Put(&session->rx, buf);
+}
+
+/**
+ * Return a buffer from Xcp_RxBorrow without processing it
+ * @param buf
+ */
+void Xcp_RxRelease(Xcp_BufferType* buf)
+{
+    Xcp_Fifo_Free(NULL, buf);
 }
 
 static uint32 Xcp_GetTimeStamp()
@@ -160,112 +406,395 @@ static uint32 Xcp_GetTimeStamp()
 #endif
 }
 
+/**
+ * Compile the ODT entries of a DAQ list into samples
+ *
+ * Each ODT will get a flat array of memory copies, stored in
+ * it's entry array, with the final offset in the DTO packet
+ * already resolved. This moves all the per entry setup out of
+ * Xcp_ProcessDaq, which then only needs to copy memory.
+ *
+ * Entries on the same address extension whose source directly
+ * follows the previous entry are merged into a single copy. Since
+ * entries are packed back to back in the DTO, this does not change
+ * the transmitted data.
+ *
+ * Addresses inside calibration segments are resolved to the page
+ * selected for XCP here, so the list must be compiled again when
+ * that page changes. STIM lists are compiled the same way, without
+ * timestamp and written through the mta of their extension.
+ *
+ * Requires the ODT entries of each ODT to be allocated as an array.
+ *
+ * @param daq DAQ list to compile
+ */
+static void Xcp_DaqCompile(Xcp_DaqListType* daq)
+{
+    int      stim = daq->XcpParams.Mode & XCP_DAQLIST_MODE_STIM;
+    int      ts   = !stim && (daq->XcpParams.Mode & XCP_DAQLIST_MODE_TIMESTAMP);
+    unsigned max  = Xcp_DaqSession(daq)->transport->MaxDto;
+
+    Xcp_OdtType* odt = daq->XcpOdt;
+    for(int o = 0; o < daq->XcpOdtCount; o++, odt = odt->XcpNextOdt) {
+        unsigned off   = XCP_DTO_HEADER_SIZE;
+        uint8    count = 0;
+
+        odt->XcpOdtTimestamp = 0;
+
+        Xcp_OdtEntryType* ent = odt->XcpOdtEntry;
+        for(int i = 0; i < odt->XcpOdtEntriesCount; i++, ent = ent->XcpNextOdtEntry) {
+            uint8 len = ent->XcpOdtEntryLength;
+            if(len == 0)
+                continue;
+
+            /* first ODT with data carries the timestamp */
+            unsigned tsl = (ts && count == 0) ? XCP_TIMESTAMP_SIZE : 0;
+
+            if(len + off + tsl > max)
+                break;
+
+            if(tsl) {
+                odt->XcpOdtTimestamp = 1;
+                off += tsl;
+                ts   = 0;
+            }
+
+            intptr_t address = Xcp_MtaPage(ent->XcpOdtEntryAddress, ent->XcpOdtEntryExtension);
+            uint8    direct  = 0;
+            uint8*   ptr     = stim ? NULL : Xcp_MtaReadPointer(address, ent->XcpOdtEntryExtension);
+            if(ptr) {
+                address = (intptr_t)ptr;
+                direct  = 1;
+            }
+
+            /* coalesce with previous sample if source directly follows it */
+            if(count) {
+                Xcp_SampleType* prv = &odt->XcpOdtEntry[count-1].XcpSample;
+                if(prv->XcpSampleExtension == ent->XcpOdtEntryExtension
+                && prv->XcpSampleDirect    == direct
+                && prv->XcpSampleAddress + prv->XcpSampleLength == address) {
+                    prv->XcpSampleLength += len;
+                    off += len;
+                    continue;
+                }
+            }
+
+            Xcp_SampleType* smp = &odt->XcpOdtEntry[count++].XcpSample;
+            smp->XcpSampleAddress   = address;
+            smp->XcpSampleDirect    = direct;
+            smp->XcpSampleExtension = ent->XcpOdtEntryExtension;
+            smp->XcpSampleLength    = len;
+            smp->XcpSampleOffset    = off;
+            off += len;
+        }
+
+        /* order samples read directly first, keeping their offsets */
+        uint8 direct = 0;
+        for(uint8 i = 0; i < count; i++) {
+            Xcp_SampleType smp = odt->XcpOdtEntry[i].XcpSample;
+            if(!smp.XcpSampleDirect)
+                continue;
+            for(uint8 j = i; j > direct; j--) {
+                odt->XcpOdtEntry[j].XcpSample = odt->XcpOdtEntry[j-1].XcpSample;
+            }
+            odt->XcpOdtEntry[direct++].XcpSample = smp;
+        }
+
+        odt->XcpOdtSampleCount = count;
+        odt->XcpOdtDirectCount = direct;
+        odt->XcpOdtLength      = off;
+    }
+    daq->XcpCompiled = 1;
+}
+
+/**
+ * Record that a DTO packet of a DAQ list was dropped
+ * and indicate it to the master if configured.
+ * @param daq
+ */
+static void Xcp_DaqOverload(Xcp_DaqListType* daq)
+{
+    if(daq->XcpOverloadCount < 0xFFFF)
+        daq->XcpOverloadCount++;
+
+    /* only indicate once until a DTO gets through again */
+    if(daq->XcpOverloaded)
+        return;
+
+    if(XCP_DAQ_OVERLOAD == XCP_DAQ_OVERLOAD_EVENT) {
+        FIFO_GET_WRITE(Xcp_DaqSession(daq)->tx, e) {
+            FIFO_ADD_U8 (e, XCP_PID_EV);
+            FIFO_ADD_U8 (e, XCP_EV_DAQ_OVERLOAD);
+            FIFO_ADD_U16(e, daq->XcpDaqListNumber);
+            FIFO_ADD_U16(e, daq->XcpOverloadCount);
+            daq->XcpOverloaded = 1;
+        }
+    } else {
+        daq->XcpOverloaded = 1;
+    }
+}
+
+/**
+ * Select the transmit queue of a DAQ list based on its priority
+ * @param daq
+ * @return fifo to queue DTO packets of the list on
+ */
+static Xcp_FifoType* Xcp_DaqFifo(Xcp_DaqListType* daq)
+{
+    /* predefined lists may be configured above what we support */
+    if(daq->XcpParams.Priority < XCP_DAQ_PRIORITY_QUEUES)
+        return Xcp_DaqSession(daq)->daq + daq->XcpParams.Priority;
+    return Xcp_DaqSession(daq)->daq + XCP_DAQ_PRIORITY_QUEUES - 1;
+}
+
+/**
+ * Allocate a DTO packet for an ODT and fill in identification
+ * and timestamp. Data area is left for Xcp_DaqSample.
+ * @param daq
+ * @param odt
+ * @param ct timestamp of the sample
+ * @return buffer or NULL if packet was dropped
+ */
+static Xcp_BufferType* Xcp_DaqBegin(Xcp_DaqListType* daq, Xcp_OdtType* odt, uint32 ct)
+{
+    Xcp_BufferType* e = Xcp_Fifo_Alloc(&Xcp_FifoFreeDaq, odt->XcpOdtLength);
+    if(e == NULL) {
+        Xcp_DaqOverload(daq);
+        return NULL;
+    }
+
+    uint8 pid = odt->XcpOdt2DtoMapping.XcpDtoPid;
+    if(daq->XcpOverloaded) {
+        if(XCP_DAQ_OVERLOAD == XCP_DAQ_OVERLOAD_MSB)
+            pid |= 0x80;
+        daq->XcpOverloaded = 0;
+    }
+    SET_UINT8 (e->data, 0, pid);
+
+    if        (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD) {
+        SET_UINT16(e->data, 1, daq->XcpDaqListNumber);
+    } else if (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD_ALIGNED) {
+        SET_UINT8 (e->data, 1, 0);  /* RESERVED */
+        SET_UINT16(e->data, 2, daq->XcpDaqListNumber);
+    } else if (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_BYTE) {
+        SET_UINT8 (e->data, 1, daq->XcpDaqListNumber);
+    }
+
+    if(odt->XcpOdtTimestamp) {
+        if     (XCP_TIMESTAMP_SIZE == 1)
+            SET_UINT8 (e->data, XCP_DTO_HEADER_SIZE, ct);
+        else if(XCP_TIMESTAMP_SIZE == 2)
+            SET_UINT16(e->data, XCP_DTO_HEADER_SIZE, ct);
+        else if(XCP_TIMESTAMP_SIZE == 4)
+            SET_UINT32(e->data, XCP_DTO_HEADER_SIZE, ct);
+    }
+
+    e->len = odt->XcpOdtLength;
+    return e;
+}
+
+/**
+ * Copy the current value of a range of compiled samples of an ODT
+ * into its DTO packet
+ * @param odt
+ * @param e packet returned from Xcp_DaqBegin
+ * @param first first sample to copy
+ * @param last sample after the last to copy
+ */
+static void Xcp_DaqSample(Xcp_OdtType* odt, Xcp_BufferType* e, uint8 first, uint8 last)
+{
+    Xcp_OdtEntryType* ent = odt->XcpOdtEntry + first;
+    Xcp_OdtEntryType* end = odt->XcpOdtEntry + last;
+    for(; ent != end; ent++) {
+        Xcp_SampleType* smp = &ent->XcpSample;
+        if(smp->XcpSampleDirect) {
+            Xcp_MemCopy(e->data + smp->XcpSampleOffset, (const uint8*)smp->XcpSampleAddress, smp->XcpSampleLength);
+        } else {
+            Xcp_MtaType mta;
+            Xcp_MtaAttach(&mta, smp->XcpSampleAddress, smp->XcpSampleExtension);
+            Xcp_MtaRead(&mta, e->data + smp->XcpSampleOffset, smp->XcpSampleLength);
+        }
+    }
+}
+
 /* Process all entries in DAQ */
 static void Xcp_ProcessDaq(Xcp_DaqListType* daq)
 {
     if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_STIM) {
-        int offset = 0;
-        if       (XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE) {
-            offset = 1;
-        } else if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_BYTE) {
-            offset = 2;
-        } else if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD) {
-            offset = 3;
-        } else if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD_ALIGNED) {
-            offset = 4;
-        }
-
         for(Xcp_OdtType* odt = daq->XcpOdt; odt ; odt = odt->XcpNextOdt) {
             if(odt->XcpStim == NULL) {
                 continue;
             }
 
-            uint8  len  = odt->XcpStim->len  - offset;
-            uint8* data = odt->XcpStim->data + offset;
-
-        	for(Xcp_OdtEntryType* ent = odt->XcpOdtEntry; ent; ent = ent->XcpNextOdtEntry) {
-        	    if(len < ent->XcpOdtEntryLength) {
+            Xcp_OdtEntryType* ent = odt->XcpOdtEntry;
+            Xcp_OdtEntryType* end = odt->XcpOdtEntry + odt->XcpOdtSampleCount;
+        	for(; ent != end; ent++) {
+        	    Xcp_SampleType* smp = &ent->XcpSample;
+        	    if(odt->XcpStim->len < smp->XcpSampleOffset + smp->XcpSampleLength) {
         	        break;
         	    }
         	    Xcp_MtaType mta;
-        	    Xcp_MtaInit(&mta, ent->XcpOdtEntryAddress, ent->XcpOdtEntryExtension);
-                Xcp_MtaWrite(&mta, data, ent->XcpOdtEntryLength);
+        	    Xcp_MtaAttach(&mta, smp->XcpSampleAddress, smp->XcpSampleExtension);
+                Xcp_MtaWrite(&mta, odt->XcpStim->data + smp->XcpSampleOffset, smp->XcpSampleLength);
                 Xcp_MtaFlush(&mta);
-
-        	    data += ent->XcpOdtEntryLength;
-        	    len  -= ent->XcpOdtEntryLength;
         	}
 
-        	Xcp_Fifo_Free(&Xcp_FifoRx, odt->XcpStim);
+        	Xcp_Fifo_Free(NULL, odt->XcpStim);
         	odt->XcpStim = NULL;
         }
         return;
 	}
 
     uint32 ct = Xcp_GetTimeStamp();
-    int    ts = daq->XcpParams.Mode & XCP_DAQLIST_MODE_TIMESTAMP;
+    Xcp_FifoType* fifo = Xcp_DaqFifo(daq);
 
     Xcp_OdtType* odt = daq->XcpOdt;
-    for(int o = 0; o < daq->XcpOdtCount; o++) {
-        if(!odt->XcpOdtEntriesValid)
+    for(int o = 0; o < daq->XcpOdtCount; o++, odt = odt->XcpNextOdt) {
+        if(!odt->XcpOdtSampleCount)
             continue;
 
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        Xcp_BufferType* e = Xcp_DaqBegin(daq, odt, ct);
+        if(e) {
+            Xcp_DaqSample(odt, e, 0, odt->XcpOdtSampleCount);
+            Xcp_Fifo_Put(fifo, e);
+        }
+    }
+}
 
-            FIFO_ADD_U8 (e, odt->XcpOdt2DtoMapping.XcpDtoPid);
+/**
+ * Allocate DTO packets for all ODT's of a DAQ list and add them to the
+ * staging area of the event channel. Packets that don't fit in it are
+ * dropped as overload.
+ * @param ech
+ * @param daq
+ * @param ct timestamp of the sample
+ * @param count number of packets already in staging area
+ * @return new number of packets in staging area
+ */
+static int Xcp_DaqPrepare(Xcp_EventChannelType* ech, Xcp_DaqListType* daq, uint32 ct, int count)
+{
+    Xcp_DaqSnapshotType* snap = ech->XcpEventChannelStaging;
+    Xcp_FifoType*        fifo = Xcp_DaqFifo(daq);
 
-            if        (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD) {
-                FIFO_ADD_U16(e, daq->XcpDaqListNumber);
-            } else if (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD_ALIGNED) {
-                FIFO_ADD_U8 (e, 0);  /* RESERVED */
-                FIFO_ADD_U16(e, daq->XcpDaqListNumber);
-            } else if (XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_BYTE) {
-                FIFO_ADD_U8(e, daq->XcpDaqListNumber);
-            }
+    Xcp_OdtType* odt = daq->XcpOdt;
+    for(int o = 0; o < daq->XcpOdtCount; o++, odt = odt->XcpNextOdt) {
+        if(!odt->XcpOdtSampleCount)
+            continue;
 
-            if(ts) {
-                if     (XCP_TIMESTAMP_SIZE == 1)
-                    FIFO_ADD_U8 (e, ct);
-                else if(XCP_TIMESTAMP_SIZE == 2)
-                    FIFO_ADD_U16(e, ct);
-                else if(XCP_TIMESTAMP_SIZE == 4)
-                    FIFO_ADD_U32(e, ct);
-                ts = 0;
-            }
-            Xcp_OdtEntryType* ent = odt->XcpOdtEntry;
-            for(int i = 0; i < odt->XcpOdtEntriesCount; i++) {
-                uint8  len = ent->XcpOdtEntryLength;
-                Xcp_MtaType mta;
-                Xcp_MtaInit(&mta, ent->XcpOdtEntryAddress, ent->XcpOdtEntryExtension);
-                if(len + e->len > XCP_MAX_DTO)
-                    break;
+        if(count == ech->XcpEventChannelMaxStaging) {
+            Xcp_DaqOverload(daq);
+            continue;
+        }
 
-                Xcp_MtaRead(&mta, e->data+e->len, len);
-                e->len += len;
-                ent = ent->XcpNextOdtEntry;
-            }
-            odt = odt->XcpNextOdt;
+        Xcp_BufferType* e = Xcp_DaqBegin(daq, odt, ct);
+        if(e) {
+            snap[count].odt  = odt;
+            snap[count].dto  = e;
+            snap[count].fifo = fifo;
+            count++;
         }
     }
+    return count;
 }
 
-/* Process all entries in event channel */
-static void Xcp_ProcessChannel(Xcp_EventChannelType* ech)
+/**
+ * Sample all packets of a snapshot, then queue them for transmission.
+ * Memory read directly is copied inside a single critical section,
+ * samples read through a memory handler (like DIO) after it, as they
+ * can take long and are not covered by the lock anyway.
+ * @param snap
+ * @param count
+ */
+static void Xcp_DaqSnapshot(Xcp_DaqSnapshotType* snap, int count)
+{
+    if(count == 0)
+        return;
+
+    imask_t mask = Xcp_EnterCritical();
+    for(int i = 0; i < count; i++)
+        Xcp_DaqSample(snap[i].odt, snap[i].dto, 0, snap[i].odt->XcpOdtDirectCount);
+    Xcp_ExitCritical(mask);
+
+    for(int i = 0; i < count; i++) {
+        Xcp_DaqSample(snap[i].odt, snap[i].dto, snap[i].odt->XcpOdtDirectCount, snap[i].odt->XcpOdtSampleCount);
+        Xcp_Fifo_Put(snap[i].fifo, snap[i].dto);
+    }
+}
+
+/**
+ * Check if a DAQ list should be processed for current event. A
+ * triggered list that was invalidated while running, by a switch
+ * of the XCP calibration page, is compiled again here in the
+ * context that samples it.
+ * @param ech
+ * @param daq
+ * @return 1 if list is triggered
+ */
+static int Xcp_DaqTriggered(Xcp_EventChannelType* ech, Xcp_DaqListType* daq)
 {
+    if(!daq)
+        return 0;
+
+    if(!(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING))
+        return 0;
+
+    if(!(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RESUME) && !Xcp_DaqSession(daq)->connected)
+        return 0;
+
+    if((ech->XcpEventChannelCounter % daq->XcpParams.Prescaler) != 0)
+        return 0;
+
+    if(!daq->XcpCompiled)
+        Xcp_DaqCompile(daq);
+
+    return 1;
+}
+
+/**
+ * Process all entries in an event channel that guarantee consistency
+ * on DAQ list or event level. All packets of a list (or of the whole
+ * event) are allocated first in the staging area of the channel, so
+ * that the data is sampled without interruption and no packet of the
+ * sample is lost to an overload.
+ * @param ech
+ */
+static void Xcp_ProcessChannelConsistent(Xcp_EventChannelType* ech)
+{
+    Xcp_DaqSnapshotType* snap  = ech->XcpEventChannelStaging;
+    int                  count = 0;
+    uint32 ct    = Xcp_GetTimeStamp();
+
     for(int d = 0; d < ech->XcpEventChannelDaqCount; d++) {
         Xcp_DaqListType* daq = ech->XcpEventChannelTriggeredDaqListRef[d];
-        if(!daq)
+        if(!Xcp_DaqTriggered(ech, daq))
             continue;
 
-        if(!(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING))
+        if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_STIM) {
+            Xcp_ProcessDaq(daq);
             continue;
+        }
 
-        if(!(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RESUME) && !Xcp_Connected)
-            continue;
+        count = Xcp_DaqPrepare(ech, daq, ct, count);
+        if(!(ech->XcpEventChannelProperties & XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_EVENT)) {
+            Xcp_DaqSnapshot(snap, count);
+            count = 0;
+        }
+    }
+    Xcp_DaqSnapshot(snap, count);
+}
 
-        if((ech->XcpEventChannelCounter % daq->XcpParams.Prescaler) != 0)
-            continue;
-        Xcp_ProcessDaq(ech->XcpEventChannelTriggeredDaqListRef[d]);
+/* Process all entries in event channel */
+static void Xcp_ProcessChannel(Xcp_EventChannelType* ech)
+{
+    if(ech->XcpEventChannelProperties & (XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_DAQ
+                                       | XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_EVENT)) {
+        Xcp_ProcessChannelConsistent(ech);
+    } else {
+        for(int d = 0; d < ech->XcpEventChannelDaqCount; d++) {
+            Xcp_DaqListType* daq = ech->XcpEventChannelTriggeredDaqListRef[d];
+            if(Xcp_DaqTriggered(ech, daq))
+                Xcp_ProcessDaq(daq);
+        }
     }
     ech->XcpEventChannelCounter++;
 }
@@ -278,7 +807,7 @@ static void Xcp_ProcessChannel(Xcp_EventChannelType* ech)
  */
 void Xcp_TxEvent(Xcp_EventType code)
 {
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_EV);
         SET_UINT8 (e->data, 1, code);
         e->len = 2;
@@ -291,7 +820,7 @@ void Xcp_TxEvent(Xcp_EventType code)
  */
 void Xcp_TxError(Xcp_ErrorType code)
 {
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_ERR);
         SET_UINT8 (e->data, 1, code);
         e->len = 2;
@@ -304,26 +833,39 @@ void Xcp_TxError(Xcp_ErrorType code)
  */
 void Xcp_TxSuccess()
 {
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_RES);
         e->len = 1;
     }
 }
 
 
+/**
+ * Abort the command the current session runs in background, if any
+ */
+static void Xcp_WorkerCancel(void)
+{
+    Xcp_Session->worker = NULL;
+}
+
 void Xcp_Disconnect()
 {
     if(!Xcp_Inited)
         return;
 
-    if(!Xcp_Connected)
-        return;
-
     Xcp_MainFunction(); /* make sure nothing is buffered */
-    Xcp_TxEvent(XCP_EV_SESSION_TERMINATED);
+    for(int i = 0; i < Xcp_SessionCount; i++) {
+        Xcp_Session = Xcp_Sessions + i;
+        if(Xcp_Session->connected)
+            Xcp_TxEvent(XCP_EV_SESSION_TERMINATED);
+    }
     Xcp_MainFunction(); /* make sure event is transmitted directly */
 
-    Xcp_Connected = 0;
+    for(int i = 0; i < Xcp_SessionCount; i++) {
+        Xcp_Session = Xcp_Sessions + i;
+        Xcp_Session->connected = 0;
+        Xcp_WorkerCancel();
+    }
 }
 
 /**************************************************************************/
@@ -347,14 +889,14 @@ static Std_ReturnType Xcp_CmdConnect(uint8 pid, void* data, int len)
     int endian = 0;
 #endif
 
-    Xcp_Connected = 1;
-
-    if(!Xcp_Connected) {
+    if(!Xcp_Session->connected) {
         /* restore varius state on a new connections */
-        Xcp_Config.XcpProtect = Xcp_ConfigOriginal->XcpProtect;
+        Xcp_Session->protect = Xcp_ConfigOriginal->XcpProtect;
     }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    Xcp_Session->connected = 1;
+
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         /* RESSOURCE */
         FIFO_ADD_U8 (e, (!!XCP_FEATURE_CALPAG) << 0 /* CAL/PAG */
@@ -366,8 +908,8 @@ static Std_ReturnType Xcp_CmdConnect(uint8 pid, void* data, int len)
                       | 0 << 1 /* ADDRESS_GRANULARITY */
                       | (!!XCP_FEATURE_BLOCKMODE) << 6 /* SLAVE_BLOCK_MODE    */
                       | 0 << 7 /* OPTIONAL */);
-        FIFO_ADD_U8 (e, XCP_MAX_CTO);
-        FIFO_ADD_U16(e, XCP_MAX_DTO);
+        FIFO_ADD_U8 (e, Xcp_Session->transport->MaxCto);
+        FIFO_ADD_U16(e, Xcp_Session->transport->MaxDto);
         FIFO_ADD_U8 (e, XCP_PROTOCOL_MAJOR_VERSION  << 4);
         FIFO_ADD_U8 (e, XCP_TRANSPORT_MAJOR_VERSION << 4);
     }
@@ -388,7 +930,7 @@ static Std_ReturnType Xcp_CmdGetStatus(uint8 pid, void* data, int len)
         }
     }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, 0 << 0 /* STORE_CAL_REQ */
                       | 0 << 2 /* STORE_DAQ_REQ */
@@ -396,7 +938,7 @@ static Std_ReturnType Xcp_CmdGetStatus(uint8 pid, void* data, int len)
                       | running << 6 /* DAQ_RUNNING */
                       | 0 << 7 /* RESUME */);
 #if(XCP_FEATURE_PROTECTION)
-        FIFO_ADD_U8 (e, Xcp_Config.XcpProtect); /* Content resource protection */
+        FIFO_ADD_U8 (e, Xcp_Session->protect); /* Content resource protection */
 #else
         FIFO_ADD_U8 (e, 0);                     /* Content resource protection */
 #endif
@@ -409,7 +951,7 @@ static Std_ReturnType Xcp_CmdGetStatus(uint8 pid, void* data, int len)
 static Std_ReturnType Xcp_CmdGetCommModeInfo(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received get_comm_mode_info\n");
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, 0); /* Reserved */
         FIFO_ADD_U8 (e, (!!XCP_FEATURE_BLOCKMODE) << 0 /* MASTER_BLOCK_MODE */
@@ -447,8 +989,8 @@ static Std_ReturnType Xcp_CmdGetId(uint8 pid, void* data, int len)
 	if(text)
 	    text_len = strlen(text);
 
-	if(text_len + 8 < XCP_MAX_CTO) {
-	    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+	if(text_len + 8 < Xcp_Session->transport->MaxCto) {
+	    FIFO_GET_WRITE_SIZE(Xcp_Session->tx, text_len + 8, e) {
 	        FIFO_ADD_U8  (e, XCP_PID_RES);
             FIFO_ADD_U8  (e, 1);        /* Mode */
 	        FIFO_ADD_U16 (e, 0);        /* Reserved */
@@ -461,8 +1003,8 @@ static Std_ReturnType Xcp_CmdGetId(uint8 pid, void* data, int len)
 	        }
 	    }
 	} else {
-        Xcp_MtaInit(&Xcp_Mta, (intptr_t)text, XCP_MTA_EXTENSION_MEMORY);
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        Xcp_MtaInit(&Xcp_Session->mta, (intptr_t)text, XCP_MTA_EXTENSION_MEMORY);
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8  (e, XCP_PID_RES);
             FIFO_ADD_U8  (e, 0);        /* Mode */
             FIFO_ADD_U16 (e, 0);        /* Reserved */
@@ -475,12 +1017,13 @@ static Std_ReturnType Xcp_CmdGetId(uint8 pid, void* data, int len)
 
 static Std_ReturnType Xcp_CmdDisconnect(uint8 pid, void* data, int len)
 {
-    if(Xcp_Connected) {
+    if(Xcp_Session->connected) {
         DEBUG(DEBUG_HIGH, "Received disconnect\n");
     } else {
         DEBUG(DEBUG_HIGH, "Invalid disconnect without connect\n");
     }
-    Xcp_Connected = 0;
+    Xcp_Session->connected = 0;
+    Xcp_WorkerCancel();
     RETURN_SUCCESS();
 }
 
@@ -498,6 +1041,15 @@ static Std_ReturnType Xcp_CmdUser(uint8 pid, void* data, int len)
     }
 }
 
+static Std_ReturnType Xcp_CmdTransportLayer(uint8 pid, void* data, int len)
+{
+    if(Xcp_Session->transport->CmdTransportLayer) {
+        return Xcp_Session->transport->CmdTransportLayer(pid, data, len);
+    } else {
+        RETURN_ERROR(XCP_ERR_CMD_UNKNOWN, "Xcp_CmdTransportLayer\n");
+    }
+}
+
 /**************************************************************************/
 /**************************************************************************/
 /*********************** UPLOAD/DOWNLOAD COMMANDS *************************/
@@ -507,47 +1059,78 @@ static Std_ReturnType Xcp_CmdUser(uint8 pid, void* data, int len)
 /**
  * Worker function for blockmode uploads
  *
- * This function will be called once every main function run and send off
- * a upload package, when done it will unregister itself from main process
+ * This function will be called once every main function run and queue
+ * upload packages, each filled with a single read of the mta, until the
+ * packet or time budget of the call is used up or no buffer is free.
+ * When done it will unregister itself from main process
  *
  */
 static void Xcp_CmdUpload_Worker(void)
 {
-    unsigned len = Xcp_Upload.rem;
     unsigned off = XCP_ELEMENT_OFFSET(1);
-    unsigned max = XCP_MAX_CTO - off - 1;
+    unsigned max = Xcp_Session->transport->MaxCto - off - 1;
 
-    if(len > max)
-        len = max;
+#if(XCP_UPLOAD_BUDGET_TIME)
+    TickType start, now;
+    if(GetCounterValue(XCP_COUNTER_ID, &start)) {
+        start = 0;
+    }
+#endif
+
+    unsigned n = 0;
+    do {
+        if(XCP_UPLOAD_BUDGET_PACKETS && n >= XCP_UPLOAD_BUDGET_PACKETS) {
+            break;
+        }
+
+#if(XCP_UPLOAD_BUDGET_TIME)
+        if(n && GetCounterValue(XCP_COUNTER_ID, &now) == 0
+             && (TickType)(now - start) >= XCP_UPLOAD_BUDGET_TIME) {
+            break;
+        }
+#endif
+
+        unsigned len = MIN(Xcp_Session->upload.rem, max);
+
+        /* retry next main function if all buffers are queued */
+        Xcp_BufferType* e = Xcp_Fifo_Alloc(Xcp_Session->tx.free, len+1+off);
+        if(e == NULL) {
+            break;
+        }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_RES);
-        for(unsigned int i = 0; i < off; i++)
-            SET_UINT8 (e->data, i+1, 0);
-        for(unsigned int i = 0; i < len; i++)
-            SET_UINT8 (e->data, i+1+off, Xcp_MtaGet(&Xcp_Mta));
+        if(off)
+            memset(e->data+1, 0, off);
+        Xcp_MtaRead(&Xcp_Session->mta, e->data+1+off, len);
         e->len = len+1+off;
-    }
-    Xcp_Upload.rem -= len;
+        Xcp_Fifo_Put(&Xcp_Session->tx, e);
 
-    if(Xcp_Upload.rem == 0)
-        Xcp_Worker = NULL;
+        Xcp_Session->upload.rem -= len;
+        n++;
+    } while(Xcp_Session->upload.rem);
+
+    if(Xcp_Session->upload.rem == 0)
+        Xcp_Session->worker = NULL;
 }
 
 static Std_ReturnType Xcp_CmdUpload(uint8 pid, void* data, int len)
 {
 	DEBUG(DEBUG_HIGH, "Received upload\n");
-	Xcp_Upload.len = GET_UINT8(data, 0) * XCP_ELEMENT_SIZE;;
-	Xcp_Upload.rem = Xcp_Upload.len;
+	Xcp_Session->upload.len = GET_UINT8(data, 0) * XCP_ELEMENT_SIZE;;
+	Xcp_Session->upload.rem = Xcp_Session->upload.len;
+
+    if(!Xcp_Session->mta.read) {
+        RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Xcp_CmdUpload - Mta not inited\n");
+    }
 
-#ifndef XCP_FEATURE_BLOCKMODE
-	if(Xcp_Upload.len + 1 > XCP_MAX_CTO) {
+#if(!XCP_FEATURE_BLOCKMODE)
+	if(Xcp_Session->upload.len + 1 > Xcp_Session->transport->MaxCto) {
 	    RETURN_ERROR(XCP_ERR_CMD_UNKNOWN, "Xcp_CmdUpload - Block mode not supported\n");
 	}
 #endif
 
-    Xcp_Worker = Xcp_CmdUpload_Worker;
-    Xcp_Worker();
+    Xcp_Session->worker = Xcp_CmdUpload_Worker;
+    Xcp_Session->worker();
     return E_OK;
 }
 
@@ -558,20 +1141,20 @@ static Std_ReturnType Xcp_CmdShortUpload(uint8 pid, void* data, int len)
     uint8  ext   = GET_UINT8 (data, 2);
     uint32 addr  = GET_UINT32(data, 3);
 
-    if(count > XCP_MAX_CTO - XCP_ELEMENT_SIZE) {
+    if(count > Xcp_Session->transport->MaxCto - XCP_ELEMENT_SIZE) {
         RETURN_ERROR(XCP_ERR_CMD_SYNTAX, "Xcp_CmdShortUpload - Too long data requested\n");
     }
 
-    Xcp_MtaInit(&Xcp_Mta, addr, ext);
-    if(Xcp_Mta.read == NULL) {
+    Xcp_MtaInit(&Xcp_Session->mta, addr, ext);
+    if(Xcp_Session->mta.read == NULL) {
         RETURN_ERROR(XCP_ERR_CMD_SYNTAX, "Xcp_CmdShortUpload - invalid memory address\n");
     }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE_SIZE(Xcp_Session->tx, count + XCP_ELEMENT_SIZE, e) {
         SET_UINT8 (e->data, 0, XCP_PID_RES);
         if(XCP_ELEMENT_SIZE > 1)
             memset(e->data+1, 0, XCP_ELEMENT_SIZE - 1);
-        Xcp_MtaRead(&Xcp_Mta, e->data + XCP_ELEMENT_SIZE, count);
+        Xcp_MtaRead(&Xcp_Session->mta, e->data + XCP_ELEMENT_SIZE, count);
         e->len = count + XCP_ELEMENT_SIZE;
     }
     return E_OK;
@@ -583,7 +1166,7 @@ static Std_ReturnType Xcp_CmdSetMTA(uint8 pid, void* data, int len)
     int ptr = GET_UINT32(data, 3);
     DEBUG(DEBUG_HIGH, "Received set_mta 0x%x, %d\n", ptr, ext);
 
-    Xcp_MtaInit(&Xcp_Mta, ptr, ext);
+    Xcp_MtaInit(&Xcp_Session->mta, ptr, ext);
     RETURN_SUCCESS();
 }
 
@@ -593,7 +1176,7 @@ static Std_ReturnType Xcp_CmdDownload(uint8 pid, void* data, int len)
     unsigned off = XCP_ELEMENT_OFFSET(2) + 1;
     DEBUG(DEBUG_HIGH, "Received download %d, %d\n", pid, len);
 
-    if(!Xcp_Mta.write) {
+    if(!Xcp_Session->mta.write) {
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Xcp_Download - Mta not inited\n");
     }
 
@@ -604,17 +1187,17 @@ static Std_ReturnType Xcp_CmdDownload(uint8 pid, void* data, int len)
 #endif
 
     if(pid == XCP_PID_CMD_CAL_DOWNLOAD) {
-        Xcp_Download.len = rem;
-        Xcp_Download.rem = rem;
+        Xcp_Session->download.len = rem;
+        Xcp_Session->download.rem = rem;
     }
 
     /* check for sequence error */
-    if(Xcp_Download.rem != rem) {
-        DEBUG(DEBUG_HIGH, "Xcp_Download - Invalid next state (%u, %u)\n", rem, Xcp_Download.rem);
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    if(Xcp_Session->download.rem != rem) {
+        DEBUG(DEBUG_HIGH, "Xcp_Download - Invalid next state (%u, %u)\n", rem, Xcp_Session->download.rem);
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_ERR);
             FIFO_ADD_U8 (e, XCP_ERR_SEQUENCE);
-            FIFO_ADD_U8 (e, Xcp_Download.rem / XCP_ELEMENT_SIZE);
+            FIFO_ADD_U8 (e, Xcp_Session->download.rem / XCP_ELEMENT_SIZE);
         }
         return E_OK;
     }
@@ -624,23 +1207,52 @@ static Std_ReturnType Xcp_CmdDownload(uint8 pid, void* data, int len)
         rem = len - off;
     }
 
-    Xcp_MtaWrite(&Xcp_Mta, (uint8*)data + off, rem);
-    Xcp_Download.rem -= rem;
+    Xcp_MtaWrite(&Xcp_Session->mta, (uint8*)data + off, rem);
+    Xcp_Session->download.rem -= rem;
 
-    if(Xcp_Download.rem)
+    if(Xcp_Session->download.rem)
         return E_OK;
 
-    Xcp_MtaFlush(&Xcp_Mta);
+    Xcp_MtaFlush(&Xcp_Session->mta);
     RETURN_SUCCESS();
 }
 
-static uint32 Xcp_CmdBuildChecksum_Add11(uint32 block)
+/**
+ * Worker function for checksum calculation
+ *
+ * This function will be called once every main function run and add
+ * up to XCP_CHECKSUM_BUDGET bytes to the checksum. When done it will
+ * send the result and unregister itself from main process
+ */
+static void Xcp_CmdBuildChecksum_Worker(void)
 {
-    uint8 res  = 0;
-    for(int i = 0; i < block; i++) {
-        res += Xcp_MtaGet(&Xcp_Mta);
+    uint32 buf[XCP_CHECKSUM_CHUNK / 4];
+    uint32 budget = XCP_CHECKSUM_BUDGET ? XCP_CHECKSUM_BUDGET : Xcp_Session->checksum_rem;
+
+    while(Xcp_Session->checksum_rem && budget) {
+        uint32 n = MIN(MIN(Xcp_Session->checksum_rem, XCP_CHECKSUM_CHUNK), budget);
+        Xcp_MtaRead(&Xcp_Session->mta, (uint8*)buf, n);
+        Xcp_ChecksumUpdate(&Xcp_Session->checksum, (const uint8*)buf, n);
+        Xcp_Session->checksum_rem -= n;
+        budget                    -= n;
+    }
+
+    if(Xcp_Session->checksum_rem) {
+        if(++Xcp_Session->pending_cycles >= XCP_CMD_PENDING_CYCLES) {
+            Xcp_Session->pending_cycles = 0;
+            Xcp_TxEvent(XCP_EV_CMD_PENDING);
+        }
+        return;
     }
-    return res;
+
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
+        FIFO_ADD_U8 (e, XCP_PID_RES);
+        FIFO_ADD_U8 (e, Xcp_Session->checksum.type);
+        FIFO_ADD_U8 (e, 0); /* reserved */
+        FIFO_ADD_U8 (e, 0); /* reserved */
+        FIFO_ADD_U32(e, Xcp_ChecksumFinal(&Xcp_Session->checksum));
+    }
+    Xcp_Session->worker = NULL;
 }
 
 static Std_ReturnType Xcp_CmdBuildChecksum(uint8 pid, void* data, int len)
@@ -649,20 +1261,35 @@ static Std_ReturnType Xcp_CmdBuildChecksum(uint8 pid, void* data, int len)
 
     DEBUG(DEBUG_HIGH, "Received build_checksum %ul\n", (unsigned int)block);
 
-    if(!Xcp_Mta.get) {
+    if(!Xcp_Session->mta.read) {
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Xcp_CmdBuildChecksum - Mta not inited\n");
     }
 
-    uint8  type = XCP_CHECKSUM_ADD_11;
-    uint32 res  = Xcp_CmdBuildChecksum_Add11(block);
+    uint8 type = Xcp_Config.XcpChecksumType;
+    if(type == 0) {
+        type = XCP_CHECKSUM_ADD_11;
+    }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
-        FIFO_ADD_U8 (e, XCP_PID_RES);
-        FIFO_ADD_U8 (e, type);
-        FIFO_ADD_U8 (e, 0); /* reserved */
-        FIFO_ADD_U8 (e, 0); /* reserved */
-        FIFO_ADD_U32(e, res);
+    uint8 elem = Xcp_ChecksumElement(type);
+    if(elem == 0) {
+        RETURN_ERROR(XCP_ERR_GENERIC, "Xcp_CmdBuildChecksum - Unsupported type %u\n", type);
     }
+
+    if(block % elem) {
+        RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Xcp_CmdBuildChecksum - Block %u not a multiple of %u\n", (unsigned)block, elem);
+    }
+
+    Xcp_ChecksumInit(&Xcp_Session->checksum, type);
+    Xcp_Session->checksum_rem = block;
+
+    /* tell master to wait for a checksum not done in this cycle */
+    if(XCP_CHECKSUM_BUDGET && block > XCP_CHECKSUM_BUDGET) {
+        Xcp_Session->pending_cycles = 0;
+        Xcp_TxEvent(XCP_EV_CMD_PENDING);
+    }
+
+    Xcp_Session->worker = Xcp_CmdBuildChecksum_Worker;
+    Xcp_Session->worker();
     return E_OK;
 }
 
@@ -673,7 +1300,17 @@ static Std_ReturnType Xcp_CmdBuildChecksum(uint8 pid, void* data, int len)
 /**************************************************************************/
 /**************************************************************************/
 #if(XCP_FEATURE_CALPAG)
-#warning Online Calibration page switching is not well supported
+
+/**
+ * Point the ecu at the page of a segment selected for it
+ * @param seg
+ */
+static void Xcp_SegmentEcuPage(Xcp_SegmentType* seg)
+{
+    if(seg->XcpEcuPointer && seg->XcpPageAddress) {
+        *seg->XcpEcuPointer = (void*)seg->XcpPageAddress[seg->XcpPageEcu];
+    }
+}
 
 static Std_ReturnType Xcp_CmdSetCalPage(uint8 pid, void* data, int len)
 {
@@ -695,18 +1332,29 @@ static Std_ReturnType Xcp_CmdSetCalPage(uint8 pid, void* data, int len)
         end   = begin + 1;
     }
 
+    /* validate all segments before switching any of them */
     for(Xcp_SegmentType* s = begin; s != end; s++) {
         if(page >= s->XcpMaxPage) {
             RETURN_ERROR(XCP_ERR_PAGE_NOT_VALID, "Xcp_CmdSetCalPage(0x%x, %u, %u) - invalid page\n", mode, s-Xcp_Config.XcpSegment, page);
         }
+    }
 
+    for(Xcp_SegmentType* s = begin; s != end; s++) {
         if(mode & 0x01) {
             s->XcpPageEcu = page;
+            Xcp_SegmentEcuPage(s);
         }
         if(mode & 0x02) {
             s->XcpPageXcp = page;
         }
     }
+
+    /* DAQ lists sample the XCP page resolved when they were compiled */
+    if(mode & 0x02) {
+        for(uint16 d = 0; d < Xcp_Config.XcpMaxDaq; d++) {
+            Xcp_GetDaq(d)->XcpCompiled = 0;
+        }
+    }
     RETURN_SUCCESS();
 }
 
@@ -729,7 +1377,7 @@ static Std_ReturnType Xcp_CmdGetCalPage(uint8 pid, void* data, int len)
         RETURN_ERROR(XCP_ERR_CMD_SYNTAX, "Xcp_CmdGetCalPage(0x%x, %u) - invalid mode\n", mode, segm);
     }
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, 0); /* reserved */
         FIFO_ADD_U8 (e, 0); /* reserved */
@@ -738,10 +1386,85 @@ static Std_ReturnType Xcp_CmdGetCalPage(uint8 pid, void* data, int len)
     return E_OK;
 }
 
+static Std_ReturnType Xcp_CmdCopyCalPage(uint8 pid, void* data, int len)
+{
+    unsigned int ssegm = GET_UINT8(data, 0);
+    unsigned int spage = GET_UINT8(data, 1);
+    unsigned int dsegm = GET_UINT8(data, 2);
+    unsigned int dpage = GET_UINT8(data, 3);
+    DEBUG(DEBUG_HIGH, "Received CopyCalPage(%u, %u, %u, %u)\n", ssegm, spage, dsegm, dpage);
+
+    if(ssegm >= Xcp_Config.XcpMaxSegment
+    || dsegm >= Xcp_Config.XcpMaxSegment) {
+        RETURN_ERROR(XCP_ERR_SEGMENT_NOT_VALID, "Xcp_CmdCopyCalPage - invalid segment\n");
+    }
+
+    Xcp_SegmentType* src = Xcp_Config.XcpSegment + ssegm;
+    Xcp_SegmentType* dst = Xcp_Config.XcpSegment + dsegm;
+
+    if(spage >= src->XcpMaxPage || src->XcpPageAddress == NULL
+    || dpage >= dst->XcpMaxPage || dst->XcpPageAddress == NULL) {
+        RETURN_ERROR(XCP_ERR_PAGE_NOT_VALID, "Xcp_CmdCopyCalPage - invalid page\n");
+    }
+
+    if(src->XcpLength    != dst->XcpLength
+    || src->XcpExtension != dst->XcpExtension) {
+        RETURN_ERROR(XCP_ERR_SEGMENT_NOT_VALID, "Xcp_CmdCopyCalPage - incompatible segments\n");
+    }
+
+    if(!(dst->XcpAccessFlags & (XCP_ACCESS_XCP_WRITE_ACCESS_WITHOUT_ECU
+                              | XCP_ACCESS_XCP_WRITE_ACCESS_WITH_ECU))) {
+        RETURN_ERROR(XCP_ERR_WRITE_PROTECTED, "Xcp_CmdCopyCalPage - segment can't be written by XCP\n");
+    }
+
+    if(Xcp_MtaCopy(dst->XcpPageAddress[dpage]
+                 , src->XcpPageAddress[spage]
+                 , dst->XcpLength
+                 , dst->XcpExtension) != E_OK) {
+        RETURN_ERROR(XCP_ERR_WRITE_PROTECTED, "Xcp_CmdCopyCalPage - page can't be written\n");
+    }
+    RETURN_SUCCESS();
+}
+
+static Std_ReturnType Xcp_CmdSetSegmentMode(uint8 pid, void* data, int len)
+{
+    unsigned int mode = GET_UINT8(data, 0);
+    unsigned int segm = GET_UINT8(data, 1);
+    DEBUG(DEBUG_HIGH, "Received SetSegmentMode(0x%x, %u)\n", mode, segm);
+
+    if(segm >= Xcp_Config.XcpMaxSegment) {
+        RETURN_ERROR(XCP_ERR_SEGMENT_NOT_VALID, "Xcp_CmdSetSegmentMode(0x%x, %u) - invalid segment\n", mode, segm);
+    }
+
+    if(mode & ~0x01) {
+        RETURN_ERROR(XCP_ERR_MODE_NOT_VALID, "Xcp_CmdSetSegmentMode(0x%x, %u) - invalid mode\n", mode, segm);
+    }
+
+    Xcp_Config.XcpSegment[segm].XcpMode = mode;
+    RETURN_SUCCESS();
+}
+
+static Std_ReturnType Xcp_CmdGetSegmentMode(uint8 pid, void* data, int len)
+{
+    unsigned int segm = GET_UINT8(data, 1);
+    DEBUG(DEBUG_HIGH, "Received GetSegmentMode(%u)\n", segm);
+
+    if(segm >= Xcp_Config.XcpMaxSegment) {
+        RETURN_ERROR(XCP_ERR_SEGMENT_NOT_VALID, "Xcp_CmdGetSegmentMode(%u) - invalid segment\n", segm);
+    }
+
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
+        FIFO_ADD_U8 (e, XCP_PID_RES);
+        FIFO_ADD_U8 (e, 0); /* reserved */
+        FIFO_ADD_U8 (e, Xcp_Config.XcpSegment[segm].XcpMode);
+    }
+    return E_OK;
+}
+
 static Std_ReturnType Xcp_CmdGetPagProcessorInfo(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received GetPagProcessorInfo\n");
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, Xcp_Config.XcpMaxSegment);
         FIFO_ADD_U8 (e, 0 << 0 /* FREEZE_SUPPORTED */);
@@ -774,7 +1497,7 @@ static Std_ReturnType Xcp_CmdGetSegmentInfo(uint8 pid, void* data, int len)
             RETURN_ERROR(XCP_ERR_CMD_SYNTAX, "Unsupported");
         }
 
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_RES);
             FIFO_ADD_U8 (e, 0); /* reserved */
             FIFO_ADD_U8 (e, 0); /* reserved */
@@ -784,7 +1507,7 @@ static Std_ReturnType Xcp_CmdGetSegmentInfo(uint8 pid, void* data, int len)
 
     } else if (mode == 1) {
 
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_RES);
             FIFO_ADD_U8 (e, seg->XcpMaxPage);
             FIFO_ADD_U8 (e, seg->XcpExtension);
@@ -811,7 +1534,7 @@ static Std_ReturnType Xcp_CmdGetSegmentInfo(uint8 pid, void* data, int len)
             RETURN_ERROR(XCP_ERR_CMD_SYNTAX, "Unsupported");
         }
 
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_RES);
             FIFO_ADD_U8 (e, 0); /* reserved */
             FIFO_ADD_U8 (e, 0); /* reserved */
@@ -839,28 +1562,25 @@ static Std_ReturnType Xcp_CmdClearDaqList(uint8 pid, void* data, int len)
     if(daqListNumber >= Xcp_Config.XcpMaxDaq || daqListNumber < Xcp_Config.XcpMinDaq )
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: Daqlist number out of range\n");
 
-    Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqListNumber ; i++ ) {
-        daq = daq->XcpNextDaq;
-    }
+    Xcp_DaqListType* daq = Xcp_GetDaq(daqListNumber);
 
     if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING)
         RETURN_ERROR(XCP_ERR_DAQ_ACTIVE, "Error: DAQ running\n");
 
-    Xcp_OdtEntryType* entry;
+    daq->XcpCompiled      = 0;
+    daq->XcpOverloadCount = 0;
+    daq->XcpOverloaded    = 0;
 
-    Xcp_OdtType* odt = daq->XcpOdt;
     for( int i = 0; i < daq->XcpOdtCount ;  i++ ) {
+        Xcp_OdtType* odt = daq->XcpOdt + i;
         odt->XcpOdtEntriesValid = 0;
-        entry = odt->XcpOdtEntry;
         for(int j = 0; j < odt->XcpOdtEntriesCount ;  j++ ) {
+            Xcp_OdtEntryType* entry = odt->XcpOdtEntry + j;
             entry->XcpOdtEntryAddress   = 0;
             entry->XcpOdtEntryExtension = 0;
             entry->XcpOdtEntryLength    = 0;
             entry->BitOffSet            = 0xFF;
-            entry = entry->XcpNextOdtEntry;
         }
-        odt = odt->XcpNextOdt;
     }
 	RETURN_SUCCESS();
 }
@@ -872,32 +1592,24 @@ static Std_ReturnType Xcp_CmdSetDaqPtr(uint8 pid, void* data, int len)
     uint8 odtEntryNumber = GET_UINT8(data, 4);
     DEBUG(DEBUG_HIGH, "Received SetDaqPtr %u, %u, %u\n", daqListNumber, odtNumber, odtEntryNumber );
 
-    Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqListNumber ; i++ ) {
-        daq = daq->XcpNextDaq;
-    }
     if(daqListNumber >= Xcp_Config.XcpMaxDaq)
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: daq list number out of range\n");
 
+    Xcp_DaqListType* daq = Xcp_GetDaq(daqListNumber);
+
     if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING)
         RETURN_ERROR(XCP_ERR_DAQ_ACTIVE, "Error: DAQ running\n");
 
     if(odtNumber >= daq->XcpMaxOdt)
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: odt number out of range (%u, %u)\n", odtNumber, daq->XcpMaxOdt);
 
-    Xcp_OdtType* odt = daq->XcpOdt;
-    for( int i = 0 ; i < odtNumber ; i ++ ) {
-        odt = odt->XcpNextOdt;
-    }
-
-    Xcp_OdtEntryType* odtEntry = odt->XcpOdtEntry;
-    for( int j = 0 ; j < odtEntryNumber ; j++ ) {
-        odtEntry = odtEntry->XcpNextOdtEntry;
-    }
+    Xcp_OdtType* odt = daq->XcpOdt + odtNumber;
 
     if(odtEntryNumber >= odt->XcpOdtEntriesCount)
 		RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: odt entry number out of range\n");
 
+    Xcp_OdtEntryType* odtEntry = odt->XcpOdtEntry + odtEntryNumber;
+
     Xcp_DaqState.daq = daq;
 	Xcp_DaqState.odt = odt;
 	Xcp_DaqState.ptr = odtEntry;
@@ -909,12 +1621,12 @@ static Std_ReturnType Xcp_CmdWriteDaq(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received WriteDaq\n");
 
-	if(Xcp_DaqState.daq->XcpDaqListNumber < Xcp_Config.XcpMinDaq) /* Check if DAQ list is write protected */
-	    RETURN_ERROR(XCP_ERR_WRITE_PROTECTED, "Error: DAQ-list is read only\n");
-
 	if(Xcp_DaqState.ptr == NULL)
 	    RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: No more ODT entries in this ODT\n");
 
+	if(Xcp_DaqState.daq->XcpDaqListNumber < Xcp_Config.XcpMinDaq) /* Check if DAQ list is write protected */
+	    RETURN_ERROR(XCP_ERR_WRITE_PROTECTED, "Error: DAQ-list is read only\n");
+
 	if(Xcp_DaqState.daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING)
 	    RETURN_ERROR(XCP_ERR_DAQ_ACTIVE, "Error: DAQ running\n");
 
@@ -963,6 +1675,7 @@ static Std_ReturnType Xcp_CmdWriteDaq(uint8 pid, void* data, int len)
         Xcp_DaqState.odt->XcpOdtEntriesValid--;
 
 	Xcp_DaqState.ptr->XcpOdtEntryLength  = daqElemSize;
+	Xcp_DaqState.daq->XcpCompiled        = 0;
 
 	Xcp_DaqState.ptr = Xcp_DaqState.ptr->XcpNextOdtEntry;
 	if(Xcp_DaqState.ptr == NULL){
@@ -990,7 +1703,14 @@ static void Xcp_CmdSetDaqListMode_EventChannel(Xcp_DaqListType* daq, uint16 newE
 			}
 		}
 	}
-    newEventChannel->XcpEventChannelTriggeredDaqListRef[newEventChannel->XcpEventChannelDaqCount] = daq;
+
+    /* keep list sorted on priority, so higher priority lists are sampled first */
+    Xcp_DaqListType** ref = newEventChannel->XcpEventChannelTriggeredDaqListRef;
+    int i = newEventChannel->XcpEventChannelDaqCount;
+    for( ; i > 0 && ref[i - 1]->XcpParams.Priority < daq->XcpParams.Priority ; i--) {
+        ref[i] = ref[i - 1];
+    }
+    ref[i] = daq;
     newEventChannel->XcpEventChannelDaqCount++;
     daq->XcpParams.EventChannel = newEventChannelNumber;
 }
@@ -1003,13 +1723,10 @@ static Std_ReturnType Xcp_CmdSetDaqListMode(uint8 pid, void* data, int len)
 		RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: daq list number out of range\n");
 
 	uint8 prio = GET_UINT8(data, 6);
-	if(prio)
+	if(prio >= XCP_DAQ_PRIORITY_QUEUES)
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Priority %d of DAQ lists is not supported\n", prio);
 
-	Xcp_DaqListType *daq = Xcp_Config.XcpDaqList;
-	for( int i = 0 ; i < list ; i++ ){
-	    daq = daq->XcpNextDaq;
-	}
+	Xcp_DaqListType *daq = Xcp_GetDaq(list);
 
 	if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_RUNNING)
 	    RETURN_ERROR(XCP_ERR_DAQ_ACTIVE, "Error: DAQ running\n");
@@ -1047,9 +1764,11 @@ static Std_ReturnType Xcp_CmdSetDaqListMode(uint8 pid, void* data, int len)
 	}
 
 	daq->XcpParams.Mode         = (GET_UINT8 (data, 0) & 0x32) | (daq->XcpParams.Mode & ~0x32);
+	daq->XcpParams.Priority		= prio;
+	daq->XcpParams.Transport    = Xcp_Session - Xcp_Sessions;
 	Xcp_CmdSetDaqListMode_EventChannel(daq,GET_UINT16(data, 3));
 	daq->XcpParams.Prescaler	= GET_UINT8 (data, 5);
-	daq->XcpParams.Priority		= prio;
+	daq->XcpCompiled            = 0;
 
 	RETURN_SUCCESS();
 }
@@ -1061,15 +1780,16 @@ static Std_ReturnType Xcp_CmdGetDaqListMode(uint8 pid, void* data, int len)
 	if(daqListNumber >= Xcp_Config.XcpMaxDaq) {
 	    RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: DAQ list number out of range\n");
 	}
-	Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-	for( int i = 0 ; i < daqListNumber ; i++ ){
-	    daq = daq->XcpNextDaq;
-	}
+	Xcp_DaqListType* daq = Xcp_GetDaq(daqListNumber);
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, daq->XcpParams.Mode);         /* Mode */
-        FIFO_ADD_U16(e, 0); 						  /* Reserved */
+#if(XCP_DAQ_OVERLOAD_COUNTER)
+        FIFO_ADD_U16(e, daq->XcpOverloadCount);       /* Reserved, used for overload counter */
+#else
+        FIFO_ADD_U16(e, 0);                           /* Reserved */
+#endif
         FIFO_ADD_U16(e, daq->XcpParams.EventChannel); /* Current Event Channel Number */
         FIFO_ADD_U8 (e, daq->XcpParams.Prescaler);	  /* Current Prescaler */
         FIFO_ADD_U8 (e, daq->XcpParams.Priority);	  /* Current DAQ list Priority */
@@ -1077,16 +1797,25 @@ static Std_ReturnType Xcp_CmdGetDaqListMode(uint8 pid, void* data, int len)
     return E_OK;
 }
 
+/**
+ * Start sampling of a DAQ list, compiling it if
+ * configuration has changed since last start.
+ * @param daq
+ */
+static void Xcp_DaqStart(Xcp_DaqListType* daq)
+{
+    if(!daq->XcpCompiled)
+        Xcp_DaqCompile(daq);
+    daq->XcpParams.Mode |= XCP_DAQLIST_MODE_RUNNING;
+}
+
 static Std_ReturnType Xcp_CmdStartStopDaqList(uint8 pid, void* data, int len)
 {
 	uint16 daqListNumber = GET_UINT16(data, 1);
 	if(daqListNumber >= Xcp_Config.XcpMaxDaq) {
 		RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: daq list number out of range\n");
 	}
-	Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqListNumber ; i++ ){
-        daq = daq->XcpNextDaq;
-    }
+	Xcp_DaqListType* daq = Xcp_GetDaq(daqListNumber);
 
 	uint8 mode = GET_UINT8(data, 0);
 	if ( mode == 0) {
@@ -1094,7 +1823,7 @@ static Std_ReturnType Xcp_CmdStartStopDaqList(uint8 pid, void* data, int len)
 	    daq->XcpParams.Mode &= ~XCP_DAQLIST_MODE_RUNNING;
 	} else if ( mode == 1) {
 		/* START */
-		daq->XcpParams.Mode |= XCP_DAQLIST_MODE_RUNNING;
+		Xcp_DaqStart(daq);
 	} else if ( mode == 2) {
 		/* SELECT */
 		daq->XcpParams.Mode |= XCP_DAQLIST_MODE_SELECTED;
@@ -1102,7 +1831,7 @@ static Std_ReturnType Xcp_CmdStartStopDaqList(uint8 pid, void* data, int len)
 		RETURN_ERROR(XCP_ERR_MODE_NOT_VALID,"Error mode not valid\n");
 	}
 
-	FIFO_GET_WRITE(Xcp_FifoTx, e) {
+	FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8(e, XCP_PID_RES);
         FIFO_ADD_U8(e, daq->XcpOdt->XcpOdt2DtoMapping.XcpDtoPid);
     }
@@ -1126,7 +1855,7 @@ static Std_ReturnType Xcp_CmdStartStopSynch(uint8 pid, void* data, int len)
         /* START SELECTED */
         for( int i = 0; i < Xcp_Config.XcpMaxDaq ; i++ ) {
             if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_SELECTED) {
-                daq->XcpParams.Mode |=  XCP_DAQLIST_MODE_RUNNING;
+                Xcp_DaqStart(daq);
                 daq->XcpParams.Mode &= ~XCP_DAQLIST_MODE_SELECTED;
             }
             daq = daq->XcpNextDaq;
@@ -1150,7 +1879,7 @@ static Std_ReturnType Xcp_CmdGetDaqClock(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received GetDaqClock\n");
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, 0); /* Alignment */
         FIFO_ADD_U8 (e, 0); /* Alignment */
@@ -1165,7 +1894,7 @@ static Std_ReturnType Xcp_CmdReadDaq(uint8 pid, void* data, int len)
     if(!Xcp_DaqState.ptr) {
         RETURN_ERROR(XCP_ERR_DAQ_CONFIG, "Error: No more ODT entries in this ODT\n");
     }
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, Xcp_DaqState.ptr->BitOffSet);
         FIFO_ADD_U8 (e, Xcp_DaqState.ptr->XcpOdtEntryLength);
         FIFO_ADD_U8 (e, Xcp_DaqState.ptr->XcpOdtEntryExtension);
@@ -1184,7 +1913,31 @@ static Std_ReturnType Xcp_CmdReadDaq(uint8 pid, void* data, int len)
 static Std_ReturnType Xcp_CmdGetDaqProcessorInfo(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received GetDaqProcessorInfo\n");
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+
+    /* report lists allocated, and until ALLOC_DAQ the lists that
+     * fit in the arena with one odt of one entry each */
+    uint32 maxDaq = Xcp_Config.XcpMaxDaq;
+#if(XCP_FEATURE_DAQSTIM_DYNAMIC)
+    if(Xcp_DaqDynamic == NULL) {
+        size_t room = XCP_DAQ_ARENA_SIZE - Xcp_DaqArenaUsed;
+        size_t cost = sizeof(Xcp_DaqListType)
+                    + Xcp_DaqAllocSize(1, sizeof(Xcp_OdtType))
+                    + Xcp_DaqAllocSize(1, sizeof(Xcp_OdtEntryType));
+        uint32 fit  = room > sizeof(intptr_t) ? (room - sizeof(intptr_t)) / cost : 0;
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+        /* each of them needs an absolute pid */
+        uint32 pids = sizeof(Xcp_DaqPid) / sizeof(Xcp_DaqPid[0]);
+        for(uint16 d = 0; d < Xcp_Config.XcpMinDaq; d++) {
+            pids -= Xcp_GetDaq(d)->XcpMaxOdt;
+        }
+        fit = MIN(fit, pids);
+#endif
+        maxDaq += fit;
+    }
+    if(maxDaq > 0xFFFF)
+        maxDaq = 0xFFFF;
+#endif
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, (XCP_FEATURE_DAQSTIM_DYNAMIC > 0 ? 1 : 0) << 0 /* DAQ_CONFIG_TYPE     */
                       | 1 << 1 /* PRESCALER_SUPPORTED */
@@ -1192,9 +1945,9 @@ static Std_ReturnType Xcp_CmdGetDaqProcessorInfo(uint8 pid, void* data, int len)
                       | 0 << 3 /* BIT_STIM_SUPPORTED  */
                       | (XCP_TIMESTAMP_SIZE > 0 ? 1 : 0) << 4 /* TIMESTAMP_SUPPORTED */
                       | 0 << 5 /* PID_OFF_SUPPORTED   */
-                      | 0 << 6 /* OVERLOAD_MSB        */
-                      | 0 << 7 /* OVERLOAD_EVENT      */);
-        FIFO_ADD_U16(e, Xcp_Config.XcpMaxDaq);
+                      | (XCP_DAQ_OVERLOAD == XCP_DAQ_OVERLOAD_MSB   ? 1 : 0) << 6 /* OVERLOAD_MSB        */
+                      | (XCP_DAQ_OVERLOAD == XCP_DAQ_OVERLOAD_EVENT ? 1 : 0) << 7 /* OVERLOAD_EVENT      */);
+        FIFO_ADD_U16(e, maxDaq);
         FIFO_ADD_U16(e, Xcp_Config.XcpMaxEventChannel);
         FIFO_ADD_U8 (e, Xcp_Config.XcpMinDaq);
         FIFO_ADD_U8 (e, 0 << 0 /* Optimisation_Type_0 */
@@ -1211,7 +1964,7 @@ static Std_ReturnType Xcp_CmdGetDaqProcessorInfo(uint8 pid, void* data, int len)
 static Std_ReturnType Xcp_CmdGetDaqResolutionInfo(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received GetDaqResolutionInfo\n");
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_RES);
         SET_UINT8 (e->data, 1, XCP_GRANULARITY_ODT_ENTRY_SIZE_DAQ);  /* GRANULARITY_ODT_ENTRY_SIZE_DAQ */
         SET_UINT8 (e->data, 2, XCP_MAX_ODT_ENTRY_SIZE_DAQ); 		 /* MAX_ODT_ENTRY_SIZE_DAQ */
@@ -1241,12 +1994,9 @@ static Std_ReturnType Xcp_CmdGetDaqListInfo(uint8 pid, void* data, int len)
 		RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Error: Xcp_GetDaqListInfo list number out of range\n");
 
 
-    Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqListNumber ; i++ ){
-        daq = daq->XcpNextDaq;
-    }
+    Xcp_DaqListType* daq = Xcp_GetDaq(daqListNumber);
 
-	FIFO_GET_WRITE(Xcp_FifoTx, e) {
+	FIFO_GET_WRITE(Xcp_Session->tx, e) {
 		SET_UINT8  (e->data, 0, XCP_PID_RES);
 		SET_UINT8  (e->data, 1, daq->XcpParams.Properties);
 		SET_UINT8  (e->data, 2, daq->XcpMaxOdt); /* MAX_ODT */
@@ -1272,10 +2022,10 @@ static Std_ReturnType Xcp_CmdGetDaqEventInfo(uint8 pid, void* data, int len)
 	uint8 namelen = 0;
 	if(eventChannel->XcpEventChannelName) {
 	    namelen = strlen(eventChannel->XcpEventChannelName);
-	    Xcp_MtaInit(&Xcp_Mta, (intptr_t)eventChannel->XcpEventChannelName, XCP_MTA_EXTENSION_MEMORY);
+	    Xcp_MtaInit(&Xcp_Session->mta, (intptr_t)eventChannel->XcpEventChannelName, XCP_MTA_EXTENSION_MEMORY);
 	}
 
-	FIFO_GET_WRITE(Xcp_FifoTx, e) {
+	FIFO_GET_WRITE(Xcp_Session->tx, e) {
 		SET_UINT8 (e->data, 0, XCP_PID_RES);
 		SET_UINT8 (e->data, 1, eventChannel->XcpEventChannelProperties );
 		SET_UINT8 (e->data, 2, eventChannel->XcpEventChannelMaxDaqList);
@@ -1291,21 +2041,27 @@ static Std_ReturnType Xcp_CmdGetDaqEventInfo(uint8 pid, void* data, int len)
 
 #if(XCP_FEATURE_DAQSTIM_DYNAMIC)
 
-static void Xcp_CmdFreeDaq_Helper(Xcp_DaqListType* daq){
-    Xcp_OdtType *odt = daq->XcpOdt;
-    Xcp_OdtType *tempOdt;
-    for( int j = 0 ; j < daq->XcpOdtCount ; j++ ){
-        Xcp_OdtEntryType *odtEntry = odt->XcpOdtEntry;
-        Xcp_OdtEntryType *tempOdtEntry;
-        for( int k = 0 ; k < odt->XcpOdtEntriesCount ; k++ ){
-            tempOdtEntry = odtEntry->XcpNextOdtEntry;
-            free(odtEntry);
-            odtEntry = tempOdtEntry;
-        }
-        tempOdt = odt->XcpNextOdt;
-        free(odt);
-        odt = tempOdt;
-    }
+/**
+ * Allocate zeroed memory for dynamic daq configuration.
+ *
+ * Memory is taken from a static arena in the order of ALLOC_DAQ,
+ * ALLOC_ODT and ALLOC_ODT_ENTRY commands and is never released
+ * individually, FREE_DAQ releases all of it at once.
+ *
+ * @param count number of elements
+ * @param size size of each element
+ * @return pointer to memory or NULL if arena is exhausted
+ */
+static void* Xcp_DaqAlloc(size_t count, size_t size)
+{
+    size_t bytes = Xcp_DaqAllocSize(count, size);
+    if(bytes > XCP_DAQ_ARENA_SIZE - Xcp_DaqArenaUsed)
+        return NULL;
+
+    void* p = Xcp_DaqArena.data + Xcp_DaqArenaUsed;
+    Xcp_DaqArenaUsed += bytes;
+    memset(p, 0, bytes);
+    return p;
 }
 
 /**
@@ -1315,21 +2071,20 @@ static void Xcp_CmdFreeDaq_Helper(Xcp_DaqListType* daq){
  * @param index Will replace the linked list at this position
  * @return Old value for the pointer
  */
-static Xcp_DaqListType * Xcp_ReplaceDaqLink(uint8 index, Xcp_DaqListType * next)
+static Xcp_DaqListType * Xcp_ReplaceDaqLink(uint16 index, Xcp_DaqListType * next)
 {
-    /* find first dynamic and last predefined */
-    Xcp_DaqListType *first = Xcp_Config.XcpDaqList, *daq = NULL;
-    for(int i = 0; i < index; i++) {
-        daq   = first;
-        first = first->XcpNextDaq;
-    }
-
-    if(daq) {
-        daq->XcpNextDaq       = next;
+    /* predefined daq lists are a contigous array */
+    Xcp_DaqListType *first;
+    if(index) {
+        Xcp_DaqListType *daq = Xcp_Config.XcpDaqList + index - 1;
+        first                = daq->XcpNextDaq;
+        daq->XcpNextDaq      = next;
     } else {
+        first                 = Xcp_Config.XcpDaqList;
         Xcp_Config.XcpDaqList = next;
     }
 
+    Xcp_DaqDynamic = next;
     return first;
 }
 
@@ -1341,7 +2096,6 @@ static Std_ReturnType Xcp_CmdFreeDaq(uint8 pid, void* data, int len)
     Xcp_Config.XcpMaxDaq = Xcp_Config.XcpMinDaq;
 
     for(Xcp_DaqListType *daq = first; daq; daq = daq->XcpNextDaq){
-        Xcp_CmdFreeDaq_Helper(daq);
         if(daq->XcpParams.EventChannel != 0xFFFF) {
             Xcp_EventChannelType* eventChannel = Xcp_Config.XcpEventChannel+daq->XcpParams.EventChannel;
             for (int i = 0 ; i < eventChannel->XcpEventChannelDaqCount ; i++ ) {
@@ -1358,24 +2112,24 @@ static Std_ReturnType Xcp_CmdFreeDaq(uint8 pid, void* data, int len)
         }
     }
 
-    /* deallocate the contigous block of daq's allocated */
-    if(first) {
-        free(first);
-    }
+    /* release all daq lists, odts and entries at once */
+    Xcp_DaqArenaUsed = 0;
 
+    Xcp_DaqIndexPid();
     Xcp_DaqState.dyn = XCP_DYNAMIC_STATE_FREE_DAQ;
     RETURN_SUCCESS();
 }
 
 static Std_ReturnType Xcp_CmdAllocDaq(uint8 pid, void* data, int len)
 {
-    if(!(Xcp_DaqState.dyn == XCP_DYNAMIC_STATE_FREE_DAQ || Xcp_DaqState.dyn == XCP_DYNAMIC_STATE_ALLOC_DAQ)) {
+    /* lists are allocated once after FREE_DAQ, a repeat would leak the arena */
+    if(Xcp_DaqState.dyn != XCP_DYNAMIC_STATE_FREE_DAQ) {
         Xcp_DaqState.dyn = XCP_DYNAMIC_STATE_UNDEFINED;
         RETURN_ERROR(XCP_ERR_SEQUENCE," ");
     }
     uint16 nrDaqs = GET_UINT16(data, 1);
 
-    Xcp_DaqListType *daq = (Xcp_DaqListType*)calloc(nrDaqs, sizeof(Xcp_DaqListType));
+    Xcp_DaqListType *daq = (Xcp_DaqListType*)Xcp_DaqAlloc(nrDaqs, sizeof(Xcp_DaqListType));
     if(daq == NULL){
         RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
     }
@@ -1390,13 +2144,16 @@ static Std_ReturnType Xcp_CmdAllocDaq(uint8 pid, void* data, int len)
                                   | XCP_DAQLIST_PROPERTY_STIM;
         daq->XcpParams.Prescaler  = 1;
         daq->XcpParams.EventChannel = 0xFFFF; // Larger than allowed.
+        daq->XcpOdt      = NULL;
         daq->XcpOdtCount = 0;
+        daq->XcpMaxOdt   = 0;
         daq->XcpNextDaq = NULL;
-        if( i > 0 ) {
+        if( i > Xcp_Config.XcpMinDaq ) {
             (daq-1)->XcpNextDaq = daq;
         }
         daq++;
     }
+    Xcp_DaqIndexPid();
     Xcp_DaqState.dyn = XCP_DYNAMIC_STATE_ALLOC_DAQ;
     RETURN_SUCCESS();
 }
@@ -1415,43 +2172,46 @@ static Std_ReturnType Xcp_CmdAllocOdt(uint8 pid, void* data, int len)
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Requested allocation to predefined daq list %u", daqNr);
     }
 
-    Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqNr ; i++ ){
-        daq = daq->XcpNextDaq;
+    Xcp_DaqListType* daq = Xcp_GetDaq(daqNr);
+
+    /* odts are only allocated once per list until FREE_DAQ */
+    if(daq->XcpOdt) {
+        RETURN_ERROR(XCP_ERR_SEQUENCE, "Error, odts already allocated for daq %u", daqNr);
     }
 
-    Xcp_OdtType* odt;
-    Xcp_OdtType *newOdt;
-    newOdt = (Xcp_OdtType*)malloc(sizeof(Xcp_OdtType));
-    if(newOdt == NULL){
-        RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+    /* absolute pids of all odts must stay below the pids of responses and events */
+    unsigned total = nrOdts;
+    for(uint16 d = 0; d < Xcp_Config.XcpMaxDaq; d++) {
+        if(d != daqNr)
+            total += Xcp_GetDaq(d)->XcpMaxOdt;
     }
-    newOdt->XcpOdtNumber = 0;
-    newOdt->XcpOdtEntriesCount = 0;
-    newOdt->XcpOdtEntriesValid = 0;
-    newOdt->XcpOdt2DtoMapping.XcpDtoPid = 0;
-    newOdt->XcpStim = NULL;
-    newOdt->XcpNextOdt = NULL;
+    if(total > sizeof(Xcp_DaqPid) / sizeof(Xcp_DaqPid[0])) {
+        RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW, "Error, %u odts can't be numbered absolutely", total);
+    }
+#endif
 
-    daq->XcpOdt = newOdt;
-    odt         = newOdt;
+    /* odts are allocated as a contigous block, so they can be indexed directly */
+    Xcp_OdtType *odt = (Xcp_OdtType*)Xcp_DaqAlloc(nrOdts, sizeof(Xcp_OdtType));
+    if(odt == NULL){
+        RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
+    }
 
-    for( uint8 i = 1 ; i < nrOdts ; i++ ){
-        newOdt = (Xcp_OdtType*)malloc(sizeof(Xcp_OdtType));
-        if(newOdt == 0){
-            RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
+    for( uint8 i = 0 ; i < nrOdts ; i++ ){
+        odt[i].XcpOdtNumber = i;
+        odt[i].XcpOdt2DtoMapping.XcpDtoPid = i;
+        if( i == nrOdts - 1 ) {
+            odt[i].XcpNextOdt = NULL;
+        } else {
+            odt[i].XcpNextOdt = odt+i+1;
         }
-        newOdt->XcpOdtNumber = i;
-        newOdt->XcpOdtEntriesCount = 0;
-        newOdt->XcpOdtEntriesValid = 0;
-        newOdt->XcpStim = NULL;
-        newOdt->XcpNextOdt = NULL;
-        odt->XcpNextOdt = newOdt;
-        odt = newOdt;
-        odt->XcpOdt2DtoMapping.XcpDtoPid = i;
     }
+
+    daq->XcpOdt      = odt;
     daq->XcpOdtCount = nrOdts;
     daq->XcpMaxOdt   = nrOdts;
+    daq->XcpCompiled = 0;
+    Xcp_DaqIndexPid();
     Xcp_DaqState.dyn = XCP_DYNAMIC_STATE_ALLOC_ODT;
     RETURN_SUCCESS();
 }
@@ -1471,43 +2231,37 @@ static Std_ReturnType Xcp_CmdAllocOdtEntry(uint8 pid, void* data, int len)
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Requested allocation to predefined daq list %u", daqNr);
     }
 
-    Xcp_DaqListType* daq = Xcp_Config.XcpDaqList;
-    for( int i = 0 ; i < daqNr ; i++ ){
-        daq = daq->XcpNextDaq;
-    }
+    Xcp_DaqListType* daq = Xcp_GetDaq(daqNr);
 
     if(odtNr >= daq->XcpMaxOdt) {
         RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Requested allocation to invalid odt for daq %u, odt %u", daqNr, odtNr);
     }
 
-    Xcp_OdtType* odt = daq->XcpOdt;
-    for(int i = 0 ; i < odtNr ; i++ ) {
-        odt = odt->XcpNextOdt;
+    Xcp_OdtType* odt = daq->XcpOdt + odtNr;
+    if(odt->XcpOdtEntry) {
+        RETURN_ERROR(XCP_ERR_SEQUENCE, "Error, entries already allocated for daq %u, odt %u", daqNr, odtNr);
     }
-    odt->XcpOdtEntriesCount = odtEntriesCount;
-    Xcp_OdtEntryType *newOdtEntry;
-
 
-    newOdtEntry = (Xcp_OdtEntryType*)malloc(sizeof(Xcp_OdtEntryType));
-    if(newOdtEntry == 0){
+    /* entries are allocated as a contigous block, since compiled samples are stored in the array */
+    Xcp_OdtEntryType *odtEntry = (Xcp_OdtEntryType*)Xcp_DaqAlloc(odtEntriesCount, sizeof(Xcp_OdtEntryType));
+    if(odtEntry == NULL){
         RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
     }
-    newOdtEntry->XcpOdtEntryNumber = 0;
-    newOdtEntry->XcpNextOdtEntry = NULL;
-    Xcp_OdtEntryType *odtEntry = newOdtEntry;
-    odt->XcpOdtEntry = newOdtEntry;
-    for( uint8 i = 1 ; i < odtEntriesCount ; i++ ){
-        newOdtEntry = (Xcp_OdtEntryType*)malloc(sizeof(Xcp_OdtEntryType));
-        if(newOdtEntry == 0){
-            RETURN_ERROR(XCP_ERR_MEMORY_OVERFLOW,"Error, memory overflow");
+
+    for( uint8 i = 0 ; i < odtEntriesCount ; i++ ){
+        odtEntry[i].XcpOdtEntryNumber = i;
+        odtEntry[i].BitOffSet         = 0xFF;
+        if( i == odtEntriesCount - 1 ) {
+            odtEntry[i].XcpNextOdtEntry = NULL;
+        } else {
+            odtEntry[i].XcpNextOdtEntry = odtEntry+i+1;
         }
-        newOdtEntry->XcpOdtEntryNumber = i;
-        newOdtEntry->XcpNextOdtEntry = NULL;
-        odtEntry->XcpNextOdtEntry = newOdtEntry;
-        odtEntry = newOdtEntry;
     }
+
+    odt->XcpOdtEntry = odtEntry;
     odt->XcpOdtEntriesCount = odtEntriesCount;
-    odt->XcpOdtEntriesValid = odtEntriesCount;
+    odt->XcpOdtEntriesValid = 0;
+    daq->XcpCompiled        = 0;
     Xcp_DaqState.dyn = XCP_DYNAMIC_STATE_ALLOC_ODT_ENTRY;
     RETURN_SUCCESS();
 }
@@ -1516,35 +2270,31 @@ static Std_ReturnType Xcp_CmdAllocOdtEntry(uint8 pid, void* data, int len)
 /**
  * Helper function to find requested odt, given a daqlist number and odt number
  *
- * Function can handle absolute odt numbers given a daq list number of 0.
+ * With absolute identification the odt number is the pid,
+ * which is looked up in the pid index and daqNr is ignored.
  *
  * @param daqNr Requested daq list.
- * @param odtNr Requested odt within daq list or following daq lists.
+ * @param odtNr Requested odt within daq list, or absolute pid.
  * @param daq Returns found daq list. NULL if could not be found.
  * @param odt Returns found odt list. NULL if could not be found.
  */
 static void Xcp_GetOdt(uint16 daqNr, uint8 odtNr, Xcp_DaqListType** daq, Xcp_OdtType** odt)
 {
-    *daq = Xcp_Config.XcpDaqList;
     *odt = NULL;
 
-    for(int i = 0; i < daqNr && *daq; i++) {
-        *daq = (*daq)->XcpNextDaq;
-    }
-
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+    *daq = odtNr < sizeof(Xcp_DaqPid) / sizeof(Xcp_DaqPid[0]) ? Xcp_DaqPid[odtNr] : NULL;
+    if(*daq == NULL)
+        return;
+    odtNr -= (*daq)->XcpOdt->XcpOdt2DtoMapping.XcpDtoPid;
+#else
+    *daq = Xcp_GetDaq(daqNr);
     if(*daq == NULL)
         return;
+#endif
 
-    *odt = (*daq)->XcpOdt;
-    for(int j = 0; j < odtNr && *odt; j++) {
-        *odt = (*odt)->XcpNextOdt;
-        if(*odt == NULL) {
-            *odt = NULL;
-            *daq = (*daq)->XcpNextDaq;
-            *odt = *daq ? (*daq)->XcpOdt : NULL;
-        }
-    }
-    return;
+    if(odtNr < (*daq)->XcpOdtCount)
+        *odt = (*daq)->XcpOdt + odtNr;
 }
 
 /**
@@ -1576,7 +2326,7 @@ static Std_ReturnType Xcp_Recieve_Stim(uint8 pid, Xcp_BufferType* it)
     }
 
     if(daq->XcpParams.Mode & XCP_DAQLIST_MODE_STIM) {
-        Xcp_Fifo_Free(&Xcp_FifoRx, odt->XcpStim);
+        Xcp_Fifo_Free(NULL, odt->XcpStim);
         odt->XcpStim = it;
         RETURN_SUCCESS();
     }
@@ -1604,14 +2354,14 @@ static Std_ReturnType Xcp_CmdGetSeed(uint8 pid, void* data, int len)
             RETURN_ERROR(XCP_ERR_OUT_OF_RANGE, "Requested invalid resource");
         }
 
-        Xcp_Unlock.res      = res;
-        Xcp_Unlock.key_len  = 0;
-        Xcp_Unlock.key_rem  = 0;
+        Xcp_Session->unlock.res      = res;
+        Xcp_Session->unlock.key_len  = 0;
+        Xcp_Session->unlock.key_rem  = 0;
 
-        Xcp_Unlock.seed_len = Xcp_Config.XcpSeedFn(res, Xcp_Unlock.seed);
-        Xcp_Unlock.seed_rem = Xcp_Unlock.seed_len;
+        Xcp_Session->unlock.seed_len = Xcp_Config.XcpSeedFn(res, Xcp_Session->unlock.seed);
+        Xcp_Session->unlock.seed_rem = Xcp_Session->unlock.seed_len;
     } else if(mode == 1){
-        if(Xcp_Unlock.res == XCP_PROTECT_NONE) {
+        if(Xcp_Session->unlock.res == XCP_PROTECT_NONE) {
             RETURN_ERROR(XCP_ERR_SEQUENCE, "Requested second part of seed before first");
         }
     } else {
@@ -1619,20 +2369,20 @@ static Std_ReturnType Xcp_CmdGetSeed(uint8 pid, void* data, int len)
     }
 
     uint8 rem;
-    if(Xcp_Unlock.seed_rem > XCP_MAX_CTO - 2)
-        rem = XCP_MAX_CTO - 2;
+    if(Xcp_Session->unlock.seed_rem > Xcp_Session->transport->MaxCto - 2)
+        rem = Xcp_Session->transport->MaxCto - 2;
     else
-        rem = Xcp_Unlock.seed_rem;
+        rem = Xcp_Session->unlock.seed_rem;
 
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE_SIZE(Xcp_Session->tx, rem + 2, e) {
         FIFO_ADD_U8(e, XCP_PID_RES);
-        FIFO_ADD_U8(e, Xcp_Unlock.seed_rem);
+        FIFO_ADD_U8(e, Xcp_Session->unlock.seed_rem);
         memcpy( e->data+e->len
-              , Xcp_Unlock.seed + Xcp_Unlock.seed_len - Xcp_Unlock.seed_rem
+              , Xcp_Session->unlock.seed + Xcp_Session->unlock.seed_len - Xcp_Session->unlock.seed_rem
               , rem);
 
         e->len              += rem;
-        Xcp_Unlock.seed_rem -= rem;
+        Xcp_Session->unlock.seed_rem -= rem;
     }
 
     return E_OK;
@@ -1643,22 +2393,22 @@ static Std_ReturnType Xcp_CmdUnlock(uint8 pid, void* data, int len)
     uint8 rem = GET_UINT8(data, 0);
     DEBUG(DEBUG_HIGH, "Received Unlock(%u)\n", rem);
 
-    if(Xcp_Unlock.res == XCP_PROTECT_NONE) {
+    if(Xcp_Session->unlock.res == XCP_PROTECT_NONE) {
         RETURN_ERROR(XCP_ERR_SEQUENCE, "Requested unlock without requesting a seed");
     }
 
     /* if this is first call, setup state */
-    if(Xcp_Unlock.key_len == 0) {
-        Xcp_Unlock.key_len = rem;
-        Xcp_Unlock.key_rem = rem;
+    if(Xcp_Session->unlock.key_len == 0) {
+        Xcp_Session->unlock.key_len = rem;
+        Xcp_Session->unlock.key_rem = rem;
     }
 
     /* validate that we are in correct sync */
-    if(Xcp_Unlock.key_rem != rem) {
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    if(Xcp_Session->unlock.key_rem != rem) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_ERR);
             FIFO_ADD_U8 (e, XCP_ERR_SEQUENCE);
-            FIFO_ADD_U8 (e, Xcp_Unlock.key_rem);
+            FIFO_ADD_U8 (e, Xcp_Session->unlock.key_rem);
         }
         return E_OK;
     }
@@ -1666,24 +2416,24 @@ static Std_ReturnType Xcp_CmdUnlock(uint8 pid, void* data, int len)
     if(rem > len - 1)
         rem = len - 1;
 
-    memcpy( Xcp_Unlock.key + Xcp_Unlock.key_len - Xcp_Unlock.key_rem
+    memcpy( Xcp_Session->unlock.key + Xcp_Session->unlock.key_len - Xcp_Session->unlock.key_rem
           , data+1
           , rem);
 
 
-    Xcp_Unlock.key_rem -= rem;
+    Xcp_Session->unlock.key_rem -= rem;
 
-    if(Xcp_Unlock.key_rem == 0) {
+    if(Xcp_Session->unlock.key_rem == 0) {
         if(Xcp_Config.XcpUnlockFn == NULL) {
             RETURN_ERROR(XCP_ERR_GENERIC, "No unlock function defines");
         }
 
-        if(Xcp_Config.XcpUnlockFn( Xcp_Unlock.res
-                                 , Xcp_Unlock.seed
-                                 , Xcp_Unlock.seed_len
-                                 , Xcp_Unlock.key
-                                 , Xcp_Unlock.key_len) == E_OK) {
-            Xcp_Config.XcpProtect &= ~Xcp_Unlock.res;
+        if(Xcp_Config.XcpUnlockFn( Xcp_Session->unlock.res
+                                 , Xcp_Session->unlock.seed
+                                 , Xcp_Session->unlock.seed_len
+                                 , Xcp_Session->unlock.key
+                                 , Xcp_Session->unlock.key_len) == E_OK) {
+            Xcp_Session->protect &= ~Xcp_Session->unlock.res;
         } else {
             RETURN_ERROR(XCP_ERR_ACCESS_LOCKED, "Failed to unlock resource");
         }
@@ -1737,7 +2487,10 @@ static Xcp_CmdListType Xcp_CmdList[256] = {
   , [XCP_PID_CMD_PAG_SET_CAL_PAGE]            = { .fun = Xcp_CmdSetCalPage          , .len = 4, .lock = XCP_PROTECT_CALPAG }
   , [XCP_PID_CMD_PAG_GET_CAL_PAGE]            = { .fun = Xcp_CmdGetCalPage          , .len = 3, .lock = XCP_PROTECT_CALPAG }
   , [XCP_PID_CMD_PAG_GET_PAG_PROCESSOR_INFO]  = { .fun = Xcp_CmdGetPagProcessorInfo , .len = 0, .lock = XCP_PROTECT_CALPAG }
-  , [XCP_PID_CMD_PAG_GET_SEGMENT_INFO]        = { .fun = Xcp_CmdGetSegmentInfo      , .len = 3, .lock = XCP_PROTECT_CALPAG }
+  , [XCP_PID_CMD_PAG_GET_SEGMENT_INFO]        = { .fun = Xcp_CmdGetSegmentInfo      , .len = 5, .lock = XCP_PROTECT_CALPAG }
+  , [XCP_PID_CMD_PAG_SET_SEGMENT_MODE]        = { .fun = Xcp_CmdSetSegmentMode      , .len = 3, .lock = XCP_PROTECT_CALPAG }
+  , [XCP_PID_CMD_PAG_GET_SEGMENT_MODE]        = { .fun = Xcp_CmdGetSegmentMode      , .len = 3, .lock = XCP_PROTECT_CALPAG }
+  , [XCP_PID_CMD_PAG_COPY_CAL_PAGE]           = { .fun = Xcp_CmdCopyCalPage         , .len = 5, .lock = XCP_PROTECT_CALPAG }
 #endif // XCP_FEATURE_CALPAG
   , [XCP_PID_CMD_CAL_DOWNLOAD]                = { .fun = Xcp_CmdDownload            , .len = 3, .lock = XCP_PROTECT_CALPAG }
 #if(XCP_FEATURE_BLOCKMODE)
@@ -1765,27 +2518,41 @@ static Xcp_CmdListType Xcp_CmdList[256] = {
 };
 
 /**
- * Xcp_Recieve_Main is the main process that executes all received commands.
+ * Xcp_Recieve_Main is the main process that executes all received commands
+ * of the current session.
  *
  * The function queues up replies for transmission. Which will be sent
  * when Xcp_Transmit_Main function is called.
  */
 void Xcp_Recieve_Main()
 {
-    FIFO_FOR_READ(Xcp_FifoRx, it) {
+    FIFO_FOR_READ(Xcp_Session->rx, it) {
         uint8 pid = GET_UINT8(it->data,0);
 
         /* ignore commands when we are not connected */
-        if(!Xcp_Connected && pid != XCP_PID_CMD_STD_CONNECT
+        if(!Xcp_Session->connected && pid != XCP_PID_CMD_STD_CONNECT
                           && pid != XCP_PID_CMD_STD_TRANSPORT_LAYER_CMD) {
             continue;
         }
 
+        /* synch, disconnect and connect abort a command running in background */
+        if(pid == XCP_PID_CMD_STD_SYNCH
+        || pid == XCP_PID_CMD_STD_DISCONNECT
+        || pid == XCP_PID_CMD_STD_CONNECT) {
+            Xcp_WorkerCancel();
+        }
+
+        /* previous command still running in background */
+        if(Xcp_Session->worker && pid > XCP_PID_CMD_STIM_LAST) {
+            Xcp_TxError(XCP_ERR_CMD_BUSY);
+            continue;
+        }
+
         /* process stim commands */
         if(pid <= XCP_PID_CMD_STIM_LAST){
 
 #if(XCP_FEATURE_PROTECTION)
-            if(Xcp_Config.XcpProtect & XCP_PROTECT_STIM) {
+            if(Xcp_Session->protect & XCP_PROTECT_STIM) {
                 Xcp_TxError(XCP_ERR_ACCESS_LOCKED);
                 continue;
             }
@@ -1802,7 +2569,7 @@ void Xcp_Recieve_Main()
         if(cmd->fun) {
 
 #if(XCP_FEATURE_PROTECTION)
-            if(cmd->lock & Xcp_Config.XcpProtect) {
+            if(cmd->lock & Xcp_Session->protect) {
                 Xcp_TxError(XCP_ERR_ACCESS_LOCKED);
                 continue;
             }
@@ -1821,23 +2588,190 @@ void Xcp_Recieve_Main()
 
 
 /**
- * Xcp_Transmit_Main transmits queued up replies
+ * Find the queue of a session to transmit from next. Command responses
+ * and events go first, then DAQ packets from highest priority down.
+ * @param session
+ * @return fifo with data, or NULL if all are empty
+ */
+static Xcp_FifoType* Xcp_Transmit_Next(Xcp_SessionType* session)
+{
+    if(Xcp_Fifo_Peek(&session->tx))
+        return &session->tx;
+
+    for(int p = XCP_DAQ_PRIORITY_QUEUES - 1; p >= 0; p--) {
+        if(Xcp_Fifo_Peek(&session->daq[p]))
+            return &session->daq[p];
+    }
+    return NULL;
+}
+
+/**
+ * Renew transmit budgets of a session, called once per main function
+ * @param session
+ */
+static void Xcp_TxBudgetStart(Xcp_SessionType* session)
+{
+    session->tx_frames = 0;
+    session->tx_bytes  = 0;
+#if(XCP_TX_RATE_BYTES)
+    session->tx_tokens = MIN(session->tx_tokens + XCP_TX_RATE_BYTES, XCP_TX_RATE_BURST);
+#endif
+#if(XCP_TX_BUDGET_TIME)
+    if(GetCounterValue(XCP_COUNTER_ID, &session->tx_start)) {
+        session->tx_start = 0;
+    }
+#endif
+}
+
+/**
+ * Check if a packet fits within what is left of the transmit budgets.
+ * The first packet of a cycle is always allowed by the byte budget.
+ * @param session
+ * @param len length of packet
+ * @return 1 if packet may be sent
+ */
+static int Xcp_TxBudgetAllows(Xcp_SessionType* session, unsigned int len)
+{
+    if(XCP_TX_BUDGET_FRAMES && session->tx_frames >= XCP_TX_BUDGET_FRAMES) {
+        return 0;
+    }
+
+    if(XCP_TX_BUDGET_BYTES && session->tx_bytes && session->tx_bytes + len > XCP_TX_BUDGET_BYTES) {
+        return 0;
+    }
+
+#if(XCP_TX_RATE_BYTES)
+    if(session->tx_tokens < len) {
+        return 0;
+    }
+#endif
+
+#if(XCP_TX_BUDGET_TIME)
+    TickType now;
+    if(GetCounterValue(XCP_COUNTER_ID, &now) == 0
+    && (TickType)(now - session->tx_start) >= XCP_TX_BUDGET_TIME) {
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * Account a packet accepted by transport against the budgets.
+ * Packets held back or paced by transport itself don't count as frames.
+ * @param session
+ * @param len length of packet
+ * @param res result of transport Transmit
+ */
+static void Xcp_TxBudgetUse(Xcp_SessionType* session, unsigned int len, Std_ReturnType res)
+{
+    session->tx_bytes += len;
+#if(XCP_TX_RATE_BYTES)
+    session->tx_tokens -= len;
+#endif
+    if(!(res & (XCP_TX_BUFFERED | XCP_TX_PIPELINED))) {
+        session->tx_frames++;
+    }
+}
+
+/**
+ * Hand queued packets of a session to its transport until it
+ * refuses or the transmit budgets of the cycle are used up
+ * @param session
+ * @param refill set when refilling from a transmit confirmation, which
+ *        only tops up what the transport has in flight: budgets are
+ *        neither checked nor used and the transport isn't flushed
  */
-void Xcp_Transmit_Main()
+static void Xcp_Transmit_Queue(Xcp_SessionType* session, int refill)
 {
-    Xcp_BufferType* item = Xcp_Fifo_Get(&Xcp_FifoTx);
-    while(item) {
-        if(Xcp_Transmit(item->data, item->len) != E_OK) {
-            Xcp_Fifo_Put_Front(&Xcp_FifoTx, item);
+    Xcp_FifoType* fifo;
+    while((fifo = Xcp_Transmit_Next(session))) {
+        Xcp_BufferType* item = Xcp_Fifo_Peek(fifo);
+        unsigned int    len  = item->len;
+        if(!refill && !Xcp_TxBudgetAllows(session, len)) {
             break;
-        } else {
-            Xcp_Fifo_Free(&Xcp_FifoTx, item);
-#if(XCP_FEATURE_TRANSMIT_FAST == STD_OFF)
-            /* transmit maximum one frame */
+        }
+
+        Std_ReturnType  res  = session->transport->Transmit(item);
+        if(res == E_NOT_OK) {
             break;
-#endif
         }
-        item = Xcp_Fifo_Get(&Xcp_FifoTx);
+
+        Xcp_Fifo_Get(fifo);
+        if(!(res & XCP_TX_RETAINED)) {
+            Xcp_Fifo_Free(fifo, item);
+        }
+        if(!refill) {
+            Xcp_TxBudgetUse(session, len, res);
+        }
+    }
+    if(!refill && session->transport->TransmitFlush) {
+        session->transport->TransmitFlush();
+    }
+}
+
+/**
+ * Make transmit passes over the queues of a session, unless a pass is
+ * already running, which then makes another one instead. The extra
+ * pass is made in the context of the running call.
+ * @param session
+ * @param refill see Xcp_Transmit_Queue
+ */
+static void Xcp_Transmit_Run(Xcp_SessionType* session, int refill)
+{
+    imask_t mask = Xcp_EnterCritical();
+    if(session->tx_busy) {
+        session->tx_again = 1;
+        Xcp_ExitCritical(mask);
+        return;
+    }
+    session->tx_busy = 1;
+    Xcp_ExitCritical(mask);
+
+    for(;;) {
+        Xcp_Transmit_Queue(session, refill);
+
+        mask = Xcp_EnterCritical();
+        if(!session->tx_again) {
+            session->tx_busy = 0;
+            Xcp_ExitCritical(mask);
+            break;
+        }
+        session->tx_again = 0;
+        Xcp_ExitCritical(mask);
+    }
+}
+
+/**
+ * Xcp_Transmit_Main transmits queued up replies of a session
+ *
+ * May be entered again from a transmit confirmation while already
+ * running, the running call then makes another pass instead.
+ * @param session
+ */
+void Xcp_Transmit_Main(Xcp_SessionType* session)
+{
+    Xcp_Transmit_Run(session, 0);
+}
+
+/**
+ * Called by transport when a frame has left, to refill
+ * lower layer from the transmit queues without waiting
+ * for next main function.
+ *
+ * Runs in the context of the lower layer confirmation, typically the
+ * CAN interrupt. It only hands queued packets to the transport until
+ * it refuses, which for CAN is when XCP_CAN_TX_IN_FLIGHT frames are in
+ * flight again. Budgets, pacing and flushing are left to the main
+ * function. When the main function is transmitting at the time, the
+ * refill is left to it.
+ * @param transport that confirmed the frame
+ */
+void Xcp_TxConfirmation(const Xcp_TransportType* transport)
+{
+    Xcp_SessionType* session = Xcp_GetSession(transport);
+    if(session) {
+        Xcp_Transmit_Run(session, 1);
     }
 }
 
@@ -1862,12 +2796,17 @@ void Xcp_MainFunction(void)
 {
     DET_VALIDATE_NRV(Xcp_Inited, 0x04, XCP_E_NOT_INITIALIZED);
 
-    /* check if we have some queued worker */
-    if(Xcp_Worker) {
-        Xcp_Worker();
-    } else {
+    for(int i = 0; i < Xcp_SessionCount; i++) {
+        Xcp_Session = Xcp_Sessions + i;
+
+        /* check if we have some queued worker, commands received
+         * while it runs in background are answered as busy */
+        if(Xcp_Session->worker) {
+            Xcp_Session->worker();
+        }
         Xcp_Recieve_Main();
+        Xcp_TxBudgetStart(Xcp_Session);
+        Xcp_Transmit_Main(Xcp_Session);
     }
-    Xcp_Transmit_Main();
 }
 
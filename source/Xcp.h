@@ -59,6 +59,7 @@ void Xcp_Init(const Xcp_ConfigType* Xcp_ConfigPtr);
 void Xcp_Disconnect();
 void Xcp_MainFunction(void);
 void Xcp_MainFunction_Channel(unsigned channel);
+Std_ReturnType Xcp_MtaRegister(uint8 extension, const Xcp_MtaExtensionType* handler);
 
 
 #define XCP_E_INV_POINTER     0x01
@@ -118,6 +119,10 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #   define XCP_FEATURE_DAQSTIM_DYNAMIC STD_OFF
 #endif
 
+#ifndef    XCP_DAQ_ARENA_SIZE
+#   define XCP_DAQ_ARENA_SIZE 4096 /**< bytes of memory available for dynamic daq configuration */
+#endif
+
 #ifndef    XCP_FEATURE_DIO
 #   define XCP_FEATURE_DIO STD_OFF
 #endif
@@ -130,6 +135,10 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #   define XCP_FEATURE_TRANSMIT_FAST STD_OFF
 #endif
 
+#ifndef    XCP_FEATURE_FIFO_LOCKFREE
+#   define XCP_FEATURE_FIFO_LOCKFREE STD_OFF
+#endif
+
 /*********************************************
  *          PROTOCOL SETTINGS                *
  *********************************************/
@@ -143,11 +152,41 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #endif
 
 
-#ifndef XCP_MAX_DTO
+#ifndef XCP_TRANSPORT_CAN
 #   if(XCP_PROTOCOL == XCP_PROTOCOL_CAN)
-#       define XCP_MAX_DTO 8
-#   elif(XCP_PROTOCOL == XCP_PROTOCOL_TCP || XCP_PROTOCOL == XCP_PROTOCOL_UDP)
+#       define XCP_TRANSPORT_CAN STD_ON  /**< build XcpOnCan transport */
+#   else
+#       define XCP_TRANSPORT_CAN STD_OFF /**< build XcpOnCan transport */
+#   endif
+#endif
+
+#ifndef XCP_TRANSPORT_ETH
+#   if(XCP_PROTOCOL == XCP_PROTOCOL_TCP || XCP_PROTOCOL == XCP_PROTOCOL_UDP)
+#       define XCP_TRANSPORT_ETH XCP_PROTOCOL /**< build XcpOnEth transport for XCP_PROTOCOL_TCP or XCP_PROTOCOL_UDP */
+#   else
+#       define XCP_TRANSPORT_ETH STD_OFF      /**< build XcpOnEth transport for XCP_PROTOCOL_TCP or XCP_PROTOCOL_UDP */
+#   endif
+#endif
+
+#ifndef    XCP_MAX_TRANSPORTS
+#   define XCP_MAX_TRANSPORTS ((XCP_TRANSPORT_CAN == STD_ON) + (XCP_TRANSPORT_ETH != STD_OFF)) /**< number of transports that can be registered */
+#endif
+
+#ifndef    XCP_CAN_FD
+#   define XCP_CAN_FD STD_OFF
+#endif
+
+#ifndef    XCP_CAN_FILL_BYTE
+#   define XCP_CAN_FILL_BYTE 0x00 /**< value used to pad CAN FD frames up to a valid length */
+#endif
+
+#ifndef XCP_MAX_DTO
+#   if(XCP_TRANSPORT_ETH != STD_OFF)
 #       define XCP_MAX_DTO 255
+#   elif(XCP_TRANSPORT_CAN == STD_ON && XCP_CAN_FD == STD_ON)
+#       define XCP_MAX_DTO 64
+#   else
+#       define XCP_MAX_DTO 8
 #   endif
 #endif
 
@@ -155,17 +194,79 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #   define XCP_MAX_CTO XCP_MAX_DTO
 #endif
 
+#ifndef XCP_CAN_MAX_DTO
+#   if(XCP_CAN_FD == STD_ON)
+#       define XCP_CAN_MAX_DTO (XCP_MAX_DTO < 64 ? XCP_MAX_DTO : 64)
+#   else
+#       define XCP_CAN_MAX_DTO 8
+#   endif
+#endif
+
+#ifndef    XCP_CAN_MAX_CTO
+#   define XCP_CAN_MAX_CTO (XCP_MAX_CTO < XCP_CAN_MAX_DTO ? XCP_MAX_CTO : XCP_CAN_MAX_DTO)
+#endif
+
+#ifndef    XCP_ETH_MAX_DTO
+#   define XCP_ETH_MAX_DTO XCP_MAX_DTO
+#endif
+
+#ifndef    XCP_ETH_MAX_CTO
+#   define XCP_ETH_MAX_CTO XCP_MAX_CTO
+#endif
+
+#ifndef    XCP_CAN_TX_IN_FLIGHT
+#   define XCP_CAN_TX_IN_FLIGHT 0 /**< frames handed to CanIf awaiting confirmation, 0 to not use confirmations */
+#endif
+
+#ifndef    XCP_CAN_TX_TIMEOUT
+#   define XCP_CAN_TX_TIMEOUT 100 /**< transmit cycles without confirmation before frames in flight are given up */
+#endif
+
+#ifndef XCP_TX_HEADROOM
+#   if(XCP_TRANSPORT_ETH != STD_OFF)
+#       define XCP_TX_HEADROOM 4 /**< bytes reserved in front of each packet for transport header */
+#   else
+#       define XCP_TX_HEADROOM 0 /**< bytes reserved in front of each packet for transport header */
+#   endif
+#endif
+
+#ifndef    XCP_ETH_MTU
+#   define XCP_ETH_MTU 1472 /**< maximum size of an ethernet frame of concatenated packets, including headers */
+#endif
+
+#ifndef    XCP_ETH_FLUSH_CYCLES
+#   define XCP_ETH_FLUSH_CYCLES 0 /**< transmit cycles a partially filled ethernet frame may be held back */
+#endif
+
+#ifndef    XCP_ETH_TX_CONFIRMATION
+#   define XCP_ETH_TX_CONFIRMATION STD_OFF /**< keep sent buffers until SoAd confirms transmission */
+#endif
+
+
+#ifndef XCP_IDENTIFICATION
+#   define XCP_IDENTIFICATION XCP_IDENTIFICATION_RELATIVE_WORD
+#endif
+
+#ifndef    XCP_DAQ_OVERLOAD
+#   define XCP_DAQ_OVERLOAD XCP_DAQ_OVERLOAD_NONE
+#endif
+
+#ifndef    XCP_DAQ_OVERLOAD_COUNTER
+#   define XCP_DAQ_OVERLOAD_COUNTER STD_OFF /**< report dropped DTO's in the reserved word of GET_DAQ_LIST_MODE */
+#endif
 
 #if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
-#   define XCP_MAX_ODT_SIZE (XCP_MAX_DTO - 1) /**< defines the maximum number of bytes that can fit in a dto packages data area*/
+#   define XCP_DTO_HEADER_SIZE 1 /**< number of bytes used for identification in a dto package */
 #elif(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_BYTE)
-#   define XCP_MAX_ODT_SIZE (XCP_MAX_DTO - 2) /**< defines the maximum number of bytes that can fit in a dto packages data area*/
+#   define XCP_DTO_HEADER_SIZE 2 /**< number of bytes used for identification in a dto package */
 #elif(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD)
-#   define XCP_MAX_ODT_SIZE (XCP_MAX_DTO - 3) /**< defines the maximum number of bytes that can fit in a dto packages data area*/
+#   define XCP_DTO_HEADER_SIZE 3 /**< number of bytes used for identification in a dto package */
 #elif(XCP_IDENTIFICATION == XCP_IDENTIFICATION_RELATIVE_WORD_ALIGNED)
-#   define XCP_MAX_ODT_SIZE (XCP_MAX_DTO - 4) /**< defines the maximum number of bytes that can fit in a dto packages data area*/
+#   define XCP_DTO_HEADER_SIZE 4 /**< number of bytes used for identification in a dto package */
 #endif
 
+#define XCP_MAX_ODT_SIZE (XCP_MAX_DTO - XCP_DTO_HEADER_SIZE) /**< defines the maximum number of bytes that can fit in a dto packages data area*/
+
 #ifndef    XCP_GRANULARITY_ODT_ENTRY_SIZE_DAQ
 #   define XCP_GRANULARITY_ODT_ENTRY_SIZE_DAQ  1
 #endif
@@ -196,36 +297,205 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #   define XCP_MAX_ODT_ENTRIES (XCP_MAX_ODT_SIZE / XCP_GRANULARITY_ODT_ENTRY_SIZE_MIN)
 #endif
 
-#ifndef XCP_IDENTIFICATION
-#   define XCP_IDENTIFICATION XCP_IDENTIFICATION_RELATIVE_WORD
-#endif
-
 #ifndef XCP_ELEMENT_SIZE
 #   define XCP_ELEMENT_SIZE 1
 #endif
 
+#ifndef    XCP_DAQ_PRIORITY_QUEUES
+#   define XCP_DAQ_PRIORITY_QUEUES 1 /**< number of DAQ list priorities, each with its own transmit queue */
+#endif
+
+#if(XCP_DAQ_PRIORITY_QUEUES < 1 || XCP_DAQ_PRIORITY_QUEUES > 256)
+#   error XCP_DAQ_PRIORITY_QUEUES must be between 1 and 256
+#endif
+
+#ifndef    XCP_TX_BUDGET_FRAMES
+#   if(XCP_FEATURE_TRANSMIT_FAST == STD_ON)
+#       define XCP_TX_BUDGET_FRAMES 0 /**< frames sent per main function call, 0 for no limit */
+#   else
+#       define XCP_TX_BUDGET_FRAMES 1 /**< frames sent per main function call, 0 for no limit */
+#   endif
+#endif
+
+#ifndef    XCP_TX_BUDGET_BYTES
+#   define XCP_TX_BUDGET_BYTES 0 /**< packet bytes sent per main function call, 0 for no limit */
+#endif
+
+#ifndef    XCP_TX_BUDGET_TIME
+#   define XCP_TX_BUDGET_TIME 0 /**< ticks of XCP_COUNTER_ID spent transmitting per main function call, 0 for no limit */
+#endif
+
+#ifndef    XCP_TX_RATE_BYTES
+#   define XCP_TX_RATE_BYTES 0 /**< token bucket refill in bytes per main function call, 0 to disable */
+#endif
+
+#ifndef    XCP_TX_RATE_BURST
+#   define XCP_TX_RATE_BURST (4 * XCP_MAX_DTO) /**< token bucket depth in bytes */
+#endif
+
+#ifndef    XCP_UPLOAD_BUDGET_PACKETS
+#   define XCP_UPLOAD_BUDGET_PACKETS 4 /**< block mode upload packets queued per main function call, 0 for no limit */
+#endif
+
+#ifndef    XCP_UPLOAD_BUDGET_TIME
+#   define XCP_UPLOAD_BUDGET_TIME 0 /**< ticks of XCP_COUNTER_ID spent filling upload packets per main function call, 0 for no limit */
+#endif
+
+#ifndef    XCP_CHECKSUM_CHUNK
+#   define XCP_CHECKSUM_CHUNK 64 /**< bytes read from mta at a time when building a checksum, on stack */
+#endif
+
+#if(XCP_CHECKSUM_CHUNK < 4 || XCP_CHECKSUM_CHUNK % 4)
+#   error XCP_CHECKSUM_CHUNK must be a multiple of 4
+#endif
+
+#ifndef    XCP_CHECKSUM_BUDGET
+#   define XCP_CHECKSUM_BUDGET 4096 /**< bytes added to a checksum per main function call, 0 for no limit */
+#endif
+
+#if(XCP_CHECKSUM_BUDGET % 4)
+#   error XCP_CHECKSUM_BUDGET must be a multiple of 4
+#endif
+
+#ifndef    XCP_CMD_PENDING_CYCLES
+#   define XCP_CMD_PENDING_CYCLES 100 /**< main function calls between EV_CMD_PENDING events while a command runs in background */
+#endif
+
+#ifndef    XCP_POOL_CTO
+#   define XCP_POOL_CTO  1 /**< buffers reserved for command responses and events */
+#endif
+
+#ifndef    XCP_POOL_RX
+#   define XCP_POOL_RX   1 /**< buffers reserved for received commands */
+#endif
+
+#ifndef    XCP_POOL_STIM
+#   define XCP_POOL_STIM 0 /**< buffers reserved for received STIM packets */
+#endif
+
+#ifndef    XCP_POOL_DAQ
+#   define XCP_POOL_DAQ  0 /**< buffers reserved for transmitted DAQ packets */
+#endif
+
+#ifndef    XCP_BUFFER_SMALL_SIZE
+#   define XCP_BUFFER_SMALL_SIZE   8 /**< data size of small buffers */
+#endif
+
+#ifndef    XCP_BUFFER_SMALL_COUNT
+#   define XCP_BUFFER_SMALL_COUNT  0 /**< number of small buffers */
+#endif
+
+#ifndef    XCP_BUFFER_MEDIUM_SIZE
+#   define XCP_BUFFER_MEDIUM_SIZE  (XCP_MAX_DTO < 64 ? XCP_MAX_DTO : 64) /**< data size of medium buffers */
+#endif
+
+#ifndef    XCP_BUFFER_MEDIUM_COUNT
+#   define XCP_BUFFER_MEDIUM_COUNT 0 /**< number of medium buffers */
+#endif
+
+/** number of XCP_MAX_DTO sized buffers, the rest of XCP_MAX_RXTX_QUEUE */
+#define XCP_BUFFER_LARGE_COUNT (XCP_MAX_RXTX_QUEUE - XCP_BUFFER_SMALL_COUNT - XCP_BUFFER_MEDIUM_COUNT)
+
 #ifndef    MODULE_ID_XCP
 #   define MODULE_ID_XCP MODULE_ID_CANXCP // XCP Routines
 #endif
 
+#if !defined(XCP_CAN_PDU_ID_RX) && defined(XCP_PDU_ID_RX)
+#   define XCP_CAN_PDU_ID_RX XCP_PDU_ID_RX /**< PDU id XcpOnCan receives on */
+#endif
+
+#if !defined(XCP_CAN_PDU_ID_TX) && defined(XCP_PDU_ID_TX)
+#   define XCP_CAN_PDU_ID_TX XCP_PDU_ID_TX /**< PDU id XcpOnCan transmits on */
+#endif
+
+#if !defined(XCP_ETH_PDU_ID_RX) && defined(XCP_PDU_ID_RX)
+#   define XCP_ETH_PDU_ID_RX XCP_PDU_ID_RX /**< PDU id XcpOnEth receives on */
+#endif
+
+#if !defined(XCP_ETH_PDU_ID_TX) && defined(XCP_PDU_ID_TX)
+#   define XCP_ETH_PDU_ID_TX XCP_PDU_ID_TX /**< PDU id XcpOnEth transmits on */
+#endif
+
 #ifndef    XCP_PDU_ID_BROADCAST
-#   define XCP_PDU_ID_BROADCAST XCP_PDU_ID_RX
+#   define XCP_PDU_ID_BROADCAST XCP_CAN_PDU_ID_RX
 #endif
 
 /*********************************************
  *          CONFIG ERROR CHECKING            *
  *********************************************/
 
-#ifndef XCP_PDU_ID_RX
-#   error XCP_PDU_ID_RX has not been defined
+#if(XCP_MAX_TRANSPORTS < 1)
+#   error No transport selected, define XCP_PROTOCOL or XCP_TRANSPORT_CAN/XCP_TRANSPORT_ETH
 #endif
 
-#ifndef XCP_PDU_ID_TX
-#   error XCP_PDU_ID_TX has not been defined
+#if(XCP_TRANSPORT_CAN == STD_ON)
+#   ifndef XCP_CAN_PDU_ID_RX
+#       error XCP_CAN_PDU_ID_RX or XCP_PDU_ID_RX has not been defined
+#   endif
+#   ifndef XCP_CAN_PDU_ID_TX
+#       error XCP_CAN_PDU_ID_TX or XCP_PDU_ID_TX has not been defined
+#   endif
 #endif
 
-#ifndef XCP_PROTOCOL
-#   error XCP_PROTOCOL has not been defined
+#if(XCP_TRANSPORT_ETH != STD_OFF)
+#   ifndef XCP_ETH_PDU_ID_RX
+#       error XCP_ETH_PDU_ID_RX or XCP_PDU_ID_RX has not been defined
+#   endif
+#   ifndef XCP_ETH_PDU_ID_TX
+#       error XCP_ETH_PDU_ID_TX or XCP_PDU_ID_TX has not been defined
+#   endif
+#   if(XCP_TRANSPORT_ETH != XCP_PROTOCOL_TCP && XCP_TRANSPORT_ETH != XCP_PROTOCOL_UDP)
+#       error XCP_TRANSPORT_ETH must be XCP_PROTOCOL_TCP or XCP_PROTOCOL_UDP
+#   endif
+#endif
+
+#if(XCP_TX_RATE_BYTES && XCP_TX_RATE_BURST < XCP_MAX_DTO)
+#   error XCP_TX_RATE_BURST must hold at least one maximum sized packet
+#endif
+
+#if(XCP_POOL_CTO + XCP_POOL_RX + XCP_POOL_STIM + XCP_POOL_DAQ > XCP_BUFFER_LARGE_COUNT)
+#   error Reserved buffer pools are larger than the number of XCP_MAX_DTO sized buffers
+#endif
+
+#if(XCP_BUFFER_LARGE_COUNT < 1)
+#   error At least one XCP_MAX_DTO sized buffer is needed
+#endif
+
+#if(XCP_BUFFER_SMALL_SIZE > XCP_BUFFER_MEDIUM_SIZE || XCP_BUFFER_MEDIUM_SIZE > XCP_MAX_DTO)
+#   error Buffer sizes must be ordered small <= medium <= XCP_MAX_DTO
+#endif
+
+#if(XCP_CAN_MAX_DTO > XCP_MAX_DTO || XCP_CAN_MAX_CTO > XCP_MAX_CTO \
+ || XCP_ETH_MAX_DTO > XCP_MAX_DTO || XCP_ETH_MAX_CTO > XCP_MAX_CTO)
+#   error Transport packet sizes can not be larger than XCP_MAX_DTO and XCP_MAX_CTO
+#endif
+
+#if(XCP_TRANSPORT_CAN == STD_ON && XCP_CAN_FD == STD_ON)
+#   define XCP_CAN_FD_LENGTH_VALID(n) ((n) <= 8  || (n) == 12 || (n) == 16 || (n) == 20 \
+                                    || (n) == 24 || (n) == 32 || (n) == 48 || (n) == 64)
+#   if(XCP_CAN_MAX_DTO < 8 || !XCP_CAN_FD_LENGTH_VALID(XCP_CAN_MAX_DTO))
+#       error XCP_CAN_MAX_DTO must be a valid CAN FD frame length
+#   endif
+#   if((XCP_BUFFER_SMALL_COUNT  && !XCP_CAN_FD_LENGTH_VALID(XCP_BUFFER_SMALL_SIZE)) \
+    || (XCP_BUFFER_MEDIUM_COUNT && !XCP_CAN_FD_LENGTH_VALID(XCP_BUFFER_MEDIUM_SIZE)))
+#       error Buffer sizes must be valid CAN FD frame lengths, so padding fits
+#   endif
+#   if(XCP_CAN_MAX_CTO > XCP_CAN_MAX_DTO)
+#       error XCP_CAN_MAX_CTO can not be larger than XCP_CAN_MAX_DTO
+#   endif
+#elif(XCP_TRANSPORT_CAN == STD_ON)
+#   if(XCP_CAN_MAX_DTO > 8 || XCP_CAN_MAX_CTO > 8)
+#       error Classic CAN supports at most 8 bytes, enable XCP_CAN_FD for larger packets
+#   endif
+#endif
+
+#if(XCP_TRANSPORT_ETH != STD_OFF)
+#   if(XCP_ETH_MTU < XCP_ETH_MAX_DTO + 4 || XCP_ETH_MTU < XCP_ETH_MAX_CTO + 4)
+#       error XCP_ETH_MTU can not hold a maximum sized packet
+#   endif
+#   if(XCP_TX_HEADROOM < 4)
+#       error XCP_TX_HEADROOM must leave room for the ethernet header
+#   endif
 #endif
 
 #if(XCP_PROTOCOL == XCP_PROTOCOL_FLEXRAY || XCP_PROTOCOL == XCP_PROTOCOL_USB)
@@ -236,11 +506,11 @@ void Xcp_MainFunction_Channel(unsigned channel);
 #   error Only element size of 1 is currently supported
 #endif
 
-#if(XCP_FEATURE_GET_SLAVE_ID == STD_ON && XCP_PROTOCOL == XCP_PROTOCOL_CAN)
+#if(XCP_FEATURE_GET_SLAVE_ID == STD_ON && XCP_TRANSPORT_CAN == STD_ON)
 #   ifndef XCP_CAN_ID_RX
 #       error No recieve can id defined (XCP_CAN_ID_RX)
 #   endif
-#   if(XCP_PDU_ID_BROADCAST == XCP_PDU_ID_RX)
+#   if(XCP_PDU_ID_BROADCAST == XCP_CAN_PDU_ID_RX)
 #       error Invalid XCP_PDU_ID_BROADCAST defined
 #   endif
 #endif
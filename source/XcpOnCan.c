@@ -17,9 +17,7 @@
 
 #include "Xcp.h"
 
-#if(XCP_PROTOCOL != XCP_PROTOCOL_CAN)
-#   error Invalid protocol defined for this source file
-#endif
+#if(XCP_TRANSPORT_CAN == STD_ON)
 
 #include "Xcp_Internal.h"
 #include "Xcp_ByteStream.h"
@@ -27,6 +25,11 @@
 #include "ComStack_Types.h"
 #include "CanIf.h"
 
+#if(XCP_CAN_TX_IN_FLIGHT)
+static volatile uint8 Xcp_CanTxInFlight = 0; /**< frames handed to CanIf, not yet confirmed */
+static uint16         Xcp_CanTxAge      = 0; /**< transmit cycles since last confirmation */
+#endif
+
 /**
  * Receive callback from CAN network layer
  *
@@ -60,16 +63,13 @@ void Xcp_CanIfRxIndication(
         return;
     }
 
-    if(XcpRxPduId != XCP_PDU_ID_RX && XcpRxPduId != XCP_PDU_ID_BROADCAST) {
+    if(XcpRxPduId != XCP_CAN_PDU_ID_RX && XcpRxPduId != XCP_PDU_ID_BROADCAST) {
         Det_ReportError(XCP_MODULE_ID, 0, 0x03, XCP_E_INVALID_PDUID);
         return;
     }
 #endif
 
-    /* TODO - How should the callback here be?
-     *        it should be general enough to
-     *        support all types of Xcp interfaces */
-    Xcp_RxIndication(XcpRxPduPtr->SduDataPtr, XcpRxPduPtr->SduLength);
+    Xcp_RxIndication(&Xcp_TransportCan, XcpRxPduPtr->SduDataPtr, XcpRxPduPtr->SduLength);
 }
 
 /**
@@ -86,7 +86,7 @@ void Xcp_CanIfRxSpecial(uint8 channel, PduIdType XcpRxPduId, const uint8 * data,
             .SduDataPtr = (uint8*)data,
             .SduLength  = len,
     };
-    Xcp_CanRxIndication(XcpRxPduId, &info);
+    Xcp_CanIfRxIndication(XcpRxPduId, &info);
 }
 
 
@@ -98,6 +98,9 @@ void Xcp_CanIfRxSpecial(uint8 channel, PduIdType XcpRxPduId, const uint8 * data,
  *
  * Reentrant for different XcpTxPduIds, non reentrant for the same XcpTxPduId
  *
+ * May be called from the CAN transmit interrupt, it only refills the
+ * XCP_CAN_TX_IN_FLIGHT frames in flight, see Xcp_TxConfirmation.
+ *
  * ServiceId: 0x02
  *
  * @param XcpRxPduId PDU-ID that has been transmitted
@@ -114,22 +117,90 @@ void Xcp_CanIfTxConfirmation(
     }
 #endif
 
-    /* TODO - mark message as transmitted and make place for a new one */
+#if(XCP_CAN_TX_IN_FLIGHT)
+    imask_t mask = Xcp_EnterCritical();
+    if(Xcp_CanTxInFlight) {
+        Xcp_CanTxInFlight--;
+    }
+    Xcp_CanTxAge = 0;
+    Xcp_ExitCritical(mask);
+
+    Xcp_TxConfirmation(&Xcp_TransportCan);
+#endif
+}
+
+#if(XCP_CAN_FD == STD_ON)
+/**
+ * Round a packet length up to the nearest length
+ * a CAN FD frame can carry (0..8, 12, 16, 20, 24, 32, 48, 64)
+ */
+static uint8 Xcp_CanFdLength(uint8 len)
+{
+    if(len <= 8)  return len;
+    if(len <= 24) return (len + 3) & ~3;
+    if(len <= 32) return 32;
+    if(len <= 48) return 48;
+    return 64;
 }
+#endif
 
 /**
  * Transport protocol agnostic transmit function called by Xcp core system
  *
- * @param data
- * @param len
+ * @param buf packet to send, CanIf copies the data so core keeps the buffer
  * @return
  */
-Std_ReturnType Xcp_Transmit(const void* data, int len)
+static Std_ReturnType Xcp_CanTransmit(Xcp_BufferType* buf)
 {
     PduInfoType pdu;
-    pdu.SduDataPtr = (uint8*)data;
-    pdu.SduLength  = len;
-    return CanIf_Transmit(XCP_PDU_ID_TX, &pdu);
+    pdu.SduDataPtr = buf->data;
+    pdu.SduLength  = buf->len;
+
+#if(XCP_CAN_FD == STD_ON)
+    /* buffer sizes are valid lengths, so padding always fits in buffer */
+    pdu.SduLength  = Xcp_CanFdLength(buf->len);
+    memset(buf->data + buf->len, XCP_CAN_FILL_BYTE, pdu.SduLength - buf->len);
+#endif
+
+#if(XCP_CAN_TX_IN_FLIGHT)
+    /* count before transmit, confirmation may arrive before it returns */
+    imask_t mask = Xcp_EnterCritical();
+    if(Xcp_CanTxInFlight >= XCP_CAN_TX_IN_FLIGHT) {
+        Xcp_ExitCritical(mask);
+        return E_NOT_OK;
+    }
+    Xcp_CanTxInFlight++;
+    Xcp_ExitCritical(mask);
+
+    if(CanIf_Transmit(XCP_CAN_PDU_ID_TX, &pdu) != E_OK) {
+        mask = Xcp_EnterCritical();
+        Xcp_CanTxInFlight--;
+        Xcp_ExitCritical(mask);
+        return E_NOT_OK;
+    }
+    return E_OK | XCP_TX_PIPELINED;
+#else
+    return CanIf_Transmit(XCP_CAN_PDU_ID_TX, &pdu);
+#endif
+}
+
+/**
+ * Called by core Xcp after each transmit cycle. CAN
+ * sends every packet directly, so nothing is held back.
+ *
+ * Frames that are never confirmed (for example lost in
+ * a bus off) are given up after XCP_CAN_TX_TIMEOUT cycles.
+ */
+static void Xcp_CanTransmitFlush(void)
+{
+#if(XCP_CAN_TX_IN_FLIGHT)
+    imask_t mask = Xcp_EnterCritical();
+    if(Xcp_CanTxInFlight && ++Xcp_CanTxAge >= XCP_CAN_TX_TIMEOUT) {
+        Xcp_CanTxInFlight = 0;
+        Xcp_CanTxAge      = 0;
+    }
+    Xcp_ExitCritical(mask);
+#endif
 }
 
 
@@ -162,7 +233,7 @@ static Std_ReturnType Xcp_CmdGetSlaveId(void* data, int len)
     }
 
     if(mode == 0) {
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_RES);
             FIFO_ADD_U8 (e, p[0]);
             FIFO_ADD_U8 (e, p[1]);
@@ -170,7 +241,7 @@ static Std_ReturnType Xcp_CmdGetSlaveId(void* data, int len)
             FIFO_ADD_U32(e, XCP_CAN_ID_RX);
         }
     } else if(mode == 1) {
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             FIFO_ADD_U8 (e, XCP_PID_RES);
             FIFO_ADD_U8 (e, ~p[0]);
             FIFO_ADD_U8 (e, ~p[1]);
@@ -192,7 +263,7 @@ static Std_ReturnType Xcp_CmdGetSlaveId(void* data, int len)
  * @param len
  * @return
  */
-extern Std_ReturnType Xcp_CmdTransportLayer(uint8 pid, void* data, int len)
+static Std_ReturnType Xcp_CanCmdTransportLayer(uint8 pid, void* data, int len)
 {
 #if(XCP_FEATURE_GET_SLAVE_ID == STD_ON)
     uint8 id = GET_UINT8(data, 0);
@@ -212,3 +283,13 @@ extern Std_ReturnType Xcp_CmdTransportLayer(uint8 pid, void* data, int len)
 
     RETURN_ERROR(XCP_ERR_CMD_UNKNOWN, "Unknown transport cmd:%u, len:%u", id, len);
 }
+
+const Xcp_TransportType Xcp_TransportCan = {
+    .Transmit          = Xcp_CanTransmit,
+    .TransmitFlush     = Xcp_CanTransmitFlush,
+    .CmdTransportLayer = Xcp_CanCmdTransportLayer,
+    .MaxCto            = XCP_CAN_MAX_CTO,
+    .MaxDto            = XCP_CAN_MAX_DTO,
+};
+
+#endif /* XCP_TRANSPORT_CAN */
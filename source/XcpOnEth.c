@@ -17,9 +17,7 @@
 
 #include "Xcp.h"
 
-#if(XCP_PROTOCOL != XCP_PROTOCOL_TCP && XCP_PROTOCOL != XCP_PROTOCOL_UDP)
-#   error Invalid protocol defined for this source file
-#endif
+#if(XCP_TRANSPORT_ETH != STD_OFF)
 
 #include "XcpOnEth_Cfg.h"
 #include "Xcp_Internal.h"
@@ -29,6 +27,108 @@
 static uint16_t Xcp_EthCtrRx = 0;
 static uint16_t Xcp_EthCtrTx = 0;
 
+#if(XCP_TRANSPORT_ETH == XCP_PROTOCOL_TCP)
+static uint8           Xcp_EthRxHeader[4];        /**< header of message split over several segments */
+static uint8           Xcp_EthRxHeaderLen = 0;
+static Xcp_BufferType* Xcp_EthRxPacket    = NULL; /**< buffer receiving the rest of the message */
+static uint16          Xcp_EthRxSkip      = 0;    /**< bytes left of a message that can't be received */
+#endif
+
+static Xcp_BufferType* Xcp_EthPacket = NULL; /**< single packet of next frame, not yet copied */
+static uint8    Xcp_EthFrame[XCP_ETH_MTU];    /**< packets concatenated into next frame */
+static uint16   Xcp_EthFrameLen = 0;          /**< bytes in next frame, including headers */
+static uint16   Xcp_EthFrameAge = 0;          /**< transmit cycles frame has been held back */
+
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+static Xcp_BufferType* volatile Xcp_EthTxPacket = NULL; /**< packet sent without copy, awaiting confirmation */
+static volatile uint8           Xcp_EthTxBusy   = 0;
+#endif
+
+
+/**
+ * Check counter in header of a message received from master
+ * @param hdr LEN/CTR header of message
+ */
+static void Xcp_EthRxCounter(const uint8* hdr)
+{
+    uint16 ctr = (hdr[3] << 8) | hdr[2];
+    Xcp_SessionType* session = Xcp_GetSession(&Xcp_TransportEth);
+    if(session && session->connected && ctr && ctr != Xcp_EthCtrRx) {
+        DEBUG(DEBUG_HIGH, "Xcp_SoAdRxIndication - ctr:%d differs from expected: %d\n", ctr, Xcp_EthCtrRx);
+    }
+
+    Xcp_EthCtrRx = ctr+1;
+}
+
+#if(XCP_TRANSPORT_ETH == XCP_PROTOCOL_TCP)
+/**
+ * Collect a message split over several TCP segments. The
+ * data is received directly into a buffer borrowed from core.
+ * @param data pointer to received data, advanced past consumed bytes
+ * @param len  length of received data, reduced by consumed bytes
+ */
+static void Xcp_EthRxPartial(const uint8** data, uint16* len)
+{
+    while(*len) {
+        /* skip remains of a message that can't be received */
+        if(Xcp_EthRxSkip) {
+            uint16 n = MIN(Xcp_EthRxSkip, *len);
+            Xcp_EthRxSkip -= n;
+            *data         += n;
+            *len          -= n;
+            continue;
+        }
+
+        /* complete header first */
+        if(Xcp_EthRxHeaderLen < 4) {
+            uint16 n = MIN(4 - Xcp_EthRxHeaderLen, *len);
+            memcpy(Xcp_EthRxHeader + Xcp_EthRxHeaderLen, *data, n);
+            Xcp_EthRxHeaderLen += n;
+            *data              += n;
+            *len               -= n;
+            if(Xcp_EthRxHeaderLen < 4) {
+                continue;
+            }
+            Xcp_EthRxCounter(Xcp_EthRxHeader);
+        }
+
+        uint16 msg = (Xcp_EthRxHeader[1] << 8) | Xcp_EthRxHeader[0];
+        if(msg == 0) {
+            Xcp_EthRxHeaderLen = 0;
+            return;
+        }
+
+        if(Xcp_EthRxPacket == NULL) {
+            /* header ended the PDU, the pid comes with the next one */
+            if(*len == 0) {
+                return;
+            }
+            if(msg <= XCP_ETH_MAX_DTO) {
+                Xcp_EthRxPacket = Xcp_RxBorrow(&Xcp_TransportEth, **data, msg);
+            }
+            if(Xcp_EthRxPacket == NULL) {
+                DEBUG(DEBUG_HIGH, "Xcp_SoAdRxIndication - dropped message of length %d\n", msg);
+                Xcp_EthRxSkip      = msg;
+                Xcp_EthRxHeaderLen = 0;
+                continue;
+            }
+        }
+
+        uint16 n = MIN(msg - Xcp_EthRxPacket->len, *len);
+        memcpy(Xcp_EthRxPacket->data + Xcp_EthRxPacket->len, *data, n);
+        Xcp_EthRxPacket->len += n;
+        *data                += n;
+        *len                 -= n;
+
+        if(Xcp_EthRxPacket->len == msg) {
+            Xcp_RxCommit(&Xcp_TransportEth, Xcp_EthRxPacket);
+            Xcp_EthRxPacket    = NULL;
+            Xcp_EthRxHeaderLen = 0;
+            return;
+        }
+    }
+}
+#endif
 
 /**
  * Receive callback from Eth network layer
@@ -36,11 +136,14 @@ static uint16_t Xcp_EthCtrTx = 0;
  * This function is called by the lower layers (i.e. FlexRay Interface, TTCAN Interface
  * and Socket Adaptor or CDD) when an AUTOSAR XCP PDU has been received
  *
+ * A PDU may contain several messages, each with its own LEN/CTR
+ * header. For TCP, messages may also be split over several PDU's.
+ *
  * Reentrant for different XcpRxPduIds,
  * non reentrant for the same XcpRxPduId
  *
  * The function Xcp_<module>RxIndication might be called
- * by the Xcp modules environment in an interrupt context
+ * by the Xcp modules environment in an interrupt context
  *
  * ServiceId: 0x03
  *
@@ -49,18 +152,40 @@ static uint16_t Xcp_EthCtrTx = 0;
  */
 void Xcp_SoAdIfRxIndication   (PduIdType XcpRxPduId, PduInfoType* XcpRxPduPtr)
 {
-    DET_VALIDATE_NRV(g_XcpConfig                   , 0x03, XCP_E_NOT_INITIALIZED);
+    DET_VALIDATE_NRV(Xcp_Inited                    , 0x03, XCP_E_NOT_INITIALIZED);
     DET_VALIDATE_NRV(XcpRxPduPtr                   , 0x03, XCP_E_INV_POINTER);
-    DET_VALIDATE_NRV(XcpRxPduId == CANIF_PDU_ID_XCP, 0x03, XCP_E_INVALID_PDUID);
+    DET_VALIDATE_NRV(XcpRxPduId == XCP_ETH_PDU_ID_RX, 0x03, XCP_E_INVALID_PDUID);
+#if(XCP_TRANSPORT_ETH == XCP_PROTOCOL_UDP)
     DET_VALIDATE_NRV(XcpRxPduPtr->SduLength > 4    , 0x03, XCP_E_INVALID_PDUID);
+#endif
 
-    uint16 ctr = (XcpRxPduPtr->SduDataPtr[3] << 8) | XcpRxPduPtr->SduDataPtr[2];
-    if(Xcp_Connected && ctr && ctr != Xcp_EthCtrRx) {
-        DEBUG(DEBUG_HIGH, "Xcp_SoAdRxIndication - ctr:%d differs from expected: %d\n", ctr, Xcp_EthCtrRx);
+    const uint8* data = XcpRxPduPtr->SduDataPtr;
+    uint16       len  = XcpRxPduPtr->SduLength;
+
+#if(XCP_TRANSPORT_ETH == XCP_PROTOCOL_TCP)
+    if(Xcp_EthRxHeaderLen || Xcp_EthRxSkip) {
+        Xcp_EthRxPartial(&data, &len);
     }
+#endif
 
-    Xcp_EthCtrRx = ctr+1;
-    Xcp_RxIndication(XcpRxPduPtr->SduDataPtr+4, XcpRxPduPtr->SduLength-4);
+    while(len >= 4) {
+        uint16 msg = (data[1] << 8) | data[0];
+        if(len < msg + 4) {
+            break;
+        }
+        Xcp_EthRxCounter(data);
+        Xcp_RxIndication(&Xcp_TransportEth, data+4, msg);
+        data += msg + 4;
+        len  -= msg + 4;
+    }
+
+#if(XCP_TRANSPORT_ETH == XCP_PROTOCOL_TCP)
+    Xcp_EthRxPartial(&data, &len);
+#else
+    if(len) {
+        DEBUG(DEBUG_HIGH, "Xcp_SoAdRxIndication - ignored %d trailing bytes\n", len);
+    }
+#endif
 }
 
 /**
@@ -77,27 +202,147 @@ void Xcp_SoAdIfRxIndication   (PduIdType XcpRxPduId, PduInfoType* XcpRxPduPtr)
  */
 void Xcp_SoAdIfTxConfirmation (PduIdType XcpRxPduId)
 {
-    DET_VALIDATE_NRV(g_XcpConfig, 0x02, XCP_E_NOT_INITIALIZED);
+    DET_VALIDATE_NRV(Xcp_Inited, 0x02, XCP_E_NOT_INITIALIZED);
+
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+    if(Xcp_EthTxPacket) {
+        Xcp_Fifo_Free(NULL, Xcp_EthTxPacket);
+        Xcp_EthTxPacket = NULL;
+    }
+    Xcp_EthTxBusy = 0;
+#endif
 }
 
 /**
- * Called by core Xcp to transmit data
- * @param data
- * @param len
- * @return
+ * Get the ethernet header of a packet, placed in
+ * the headroom directly in front of its data
  */
-Std_ReturnType Xcp_Transmit(const void* data, int len)
+static inline uint8* Xcp_EthHeader(Xcp_BufferType* buf)
+{
+    return buf->data - 4;
+}
+
+/**
+ * Send the frame of concatenated packets. A frame with a single
+ * packet is sent directly from the packet buffer without copy.
+ * @return E_OK if frame was sent and can be refilled
+ */
+static Std_ReturnType Xcp_EthSend(void)
 {
-    uint8 buf[len+4];
     PduInfoType pdu;
-    pdu.SduDataPtr = buf;
-    pdu.SduLength  = len+4;
 
-    SET_UINT16(buf, 0, len);
-    SET_UINT16(buf, 2, ++Xcp_EthCtrTx);
-    memcpy(buf+4, data, len);
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+    if(Xcp_EthTxBusy) {
+        return E_NOT_OK;
+    }
+#endif
+
+    if(Xcp_EthPacket) {
+        pdu.SduDataPtr = Xcp_EthHeader(Xcp_EthPacket);
+    } else {
+        pdu.SduDataPtr = Xcp_EthFrame;
+    }
+    pdu.SduLength  = Xcp_EthFrameLen;
+
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+    /* confirmation may arrive before transmit returns */
+    Xcp_EthTxPacket = Xcp_EthPacket;
+    Xcp_EthTxBusy   = 1;
+#endif
+
+    if(SoAdIf_Transmit(XCP_ETH_PDU_ID_TX, &pdu) != E_OK) {
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+        Xcp_EthTxPacket = NULL;
+        Xcp_EthTxBusy   = 0;
+#endif
+        return E_NOT_OK;
+    }
+
+#if(XCP_ETH_TX_CONFIRMATION == STD_OFF)
+    if(Xcp_EthPacket) {
+        Xcp_Fifo_Free(NULL, Xcp_EthPacket);
+    }
+#endif
+    Xcp_EthPacket   = NULL;
+    Xcp_EthFrameLen = 0;
+    Xcp_EthFrameAge = 0;
+    return E_OK;
+}
+
+/**
+ * Called by core Xcp to transmit data
+ *
+ * Packets are concatenated, each with its own header, into
+ * a frame of at most XCP_ETH_MTU bytes. The frame is sent
+ * when the next packet does not fit or by Xcp_EthTransmitFlush.
+ *
+ * The first packet of a frame is kept in its own buffer with
+ * the header written into the headroom, it's only copied if
+ * another packet is added to the same frame.
+ *
+ * @param buf packet to send
+ * @return E_NOT_OK if packet could not be accepted, else E_OK
+ *         with XCP_TX_BUFFERED set if no frame was sent and
+ *         XCP_TX_RETAINED if buffer is kept by transport
+ */
+static Std_ReturnType Xcp_EthTransmit(Xcp_BufferType* buf)
+{
+    Std_ReturnType res = XCP_TX_BUFFERED;
+
+    if(Xcp_EthFrameLen + buf->len + 4 > XCP_ETH_MTU) {
+        if(Xcp_EthSend() != E_OK) {
+            return E_NOT_OK;
+        }
+        res = E_OK;
+    }
+
+    if(Xcp_EthPacket) {
+#if(XCP_ETH_TX_CONFIRMATION == STD_ON)
+        /* frame buffer is still in use by previous transmit */
+        if(Xcp_EthTxBusy && Xcp_EthTxPacket == NULL) {
+            return E_NOT_OK;
+        }
+#endif
+        memcpy(Xcp_EthFrame, Xcp_EthHeader(Xcp_EthPacket), Xcp_EthFrameLen);
+        Xcp_Fifo_Free(NULL, Xcp_EthPacket);
+        Xcp_EthPacket = NULL;
+    }
+
+    uint8* hdr = Xcp_EthHeader(buf);
+    Xcp_EthCtrTx++;
+    hdr[0] = (uint8)(buf->len);
+    hdr[1] = (uint8)(buf->len >> 8);
+    hdr[2] = (uint8)(Xcp_EthCtrTx);
+    hdr[3] = (uint8)(Xcp_EthCtrTx >> 8);
+
+    if(Xcp_EthFrameLen == 0) {
+        Xcp_EthPacket = buf;
+        res |= XCP_TX_RETAINED;
+    } else {
+        memcpy(Xcp_EthFrame + Xcp_EthFrameLen, hdr, buf->len + 4);
+    }
+    Xcp_EthFrameLen += buf->len + 4;
+    return res;
+}
 
-    return SoAdIf_Transmit(XCP_PDU_ID_TX, &pdu);
+/**
+ * Called by core Xcp after each transmit cycle. Sends the
+ * partially filled frame once it has been held back for
+ * XCP_ETH_FLUSH_CYCLES cycles.
+ */
+static void Xcp_EthTransmitFlush(void)
+{
+    if(Xcp_EthFrameLen == 0) {
+        return;
+    }
+
+    if(Xcp_EthFrameAge < XCP_ETH_FLUSH_CYCLES) {
+        Xcp_EthFrameAge++;
+        return;
+    }
+
+    /* on failure frame is retried next cycle */
+    Xcp_EthSend();
 }
 
 /**
@@ -107,8 +352,18 @@ Std_ReturnType Xcp_Transmit(const void* data, int len)
  * @param len
  * @return
  */
-extern Std_ReturnType Xcp_CmdTransportLayer(uint8 pid, void* data, int len)
+static Std_ReturnType Xcp_EthCmdTransportLayer(uint8 pid, void* data, int len)
 {
     Xcp_TxError(XCP_ERR_CMD_UNKNOWN);
     return E_OK;
 }
+
+const Xcp_TransportType Xcp_TransportEth = {
+    .Transmit          = Xcp_EthTransmit,
+    .TransmitFlush     = Xcp_EthTransmitFlush,
+    .CmdTransportLayer = Xcp_EthCmdTransportLayer,
+    .MaxCto            = XCP_ETH_MAX_CTO,
+    .MaxDto            = XCP_ETH_MAX_DTO,
+};
+
+#endif /* XCP_TRANSPORT_ETH */
@@ -19,7 +19,7 @@
 #define XCP_BYTESTREAM_H_
 #include "Xcp_Internal.h"
 
-#if XCP_STANDALONE
+#ifdef XCP_STANDALONE
 #include "XcpStandalone.h"
 #else
 #include "McuExtensions.h"
@@ -42,37 +42,162 @@
          (*(uint32*)((uint8*)(data)+(offset))) = (value); \
         } while(0)
 
+/* CRITICAL SECTION */
+
+static inline imask_t Xcp_EnterCritical(void)
+{
+#ifdef XCP_STANDALONE
+    XcpStandaloneLock();
+    return 0;
+#else
+    return McuE_EnterCriticalSection();
+#endif
+}
+
+static inline void Xcp_ExitCritical(imask_t mask)
+{
+#ifdef XCP_STANDALONE
+    (void)mask;
+    XcpStandaloneUnlock();
+#else
+    McuE_ExitCriticalSection(mask);
+#endif
+}
+
 /* RX/TX FIFO */
 
 typedef struct Xcp_BufferType {
     unsigned int           len;
-    unsigned char          data[XCP_MAX_DTO];
+    unsigned char*         data; /**< pool->size bytes, with XCP_TX_HEADROOM bytes reserved in front */
     struct Xcp_BufferType* next;
+    struct Xcp_FifoType*   pool; /**< pool buffer is returned to when freed */
 } Xcp_BufferType;
 
+#if(XCP_FEATURE_FIFO_LOCKFREE)
+
+/* Lock free fifo, implemented as a ring of indices into Xcp_Buffers.
+ *
+ * Writers claim a position by incrementing tail, then store the buffer
+ * index in the cell tagged with the position it was written for. Readers
+ * take the cell at head if it carries the tag for that position and claim
+ * it by moving head forward.
+ *
+ * Ring must be able to hold every buffer at the same time, so a cell is
+ * always consumed before a writer wraps around to it. Neither side ever
+ * waits for the other, so it is safe to use from interrupts and from
+ * tasks that preempt each other. */
+
+#include <stdatomic.h>
+
+#define XCP_FIFO_SMEAR1(x) ((x) | ((x) >> 1))
+#define XCP_FIFO_SMEAR2(x) (XCP_FIFO_SMEAR1(x) | (XCP_FIFO_SMEAR1(x) >> 2))
+#define XCP_FIFO_SMEAR4(x) (XCP_FIFO_SMEAR2(x) | (XCP_FIFO_SMEAR2(x) >> 4))
+
+#ifndef    XCP_FIFO_SIZE
+#   define XCP_FIFO_SIZE (XCP_FIFO_SMEAR4(XCP_MAX_RXTX_QUEUE - 1) + 1)
+#endif
+
+#if(XCP_FIFO_SIZE & (XCP_FIFO_SIZE - 1))
+#   error XCP_FIFO_SIZE must be a power of two
+#endif
+
+#if(XCP_FIFO_SIZE < XCP_MAX_RXTX_QUEUE)
+#   error XCP_FIFO_SIZE must be able to hold XCP_MAX_RXTX_QUEUE buffers
+#endif
+
+#if(XCP_MAX_RXTX_QUEUE > 256)
+#   error Lock free fifo only support up to 256 buffers
+#endif
+
+#define XCP_FIFO_CELL(pos, index)      ((((pos) + 1u) << 8) | (index))
+#define XCP_FIFO_CELL_VALID(cell, pos) (((cell) >> 8) == (((pos) + 1u) & 0xFFFFFFu))
+
+extern Xcp_BufferType Xcp_Buffers[];
+
+typedef struct Xcp_FifoType {
+    atomic_uint            head;
+    atomic_uint            tail;
+    atomic_uint            cell[XCP_FIFO_SIZE];
+    struct Xcp_FifoType*   free;
+    unsigned int           size; /**< data size of buffers in pool */
+} Xcp_FifoType;
+
+static inline Xcp_BufferType* Xcp_Fifo_Get(Xcp_FifoType* q)
+{
+    unsigned pos = atomic_load_explicit(&q->head, memory_order_acquire);
+    for(;;) {
+        unsigned cell = atomic_load_explicit(&q->cell[pos & (XCP_FIFO_SIZE - 1)], memory_order_acquire);
+        if(!XCP_FIFO_CELL_VALID(cell, pos)) {
+            /* either empty or another reader claimed it */
+            unsigned cur = atomic_load_explicit(&q->head, memory_order_acquire);
+            if(cur == pos)
+                return NULL;
+            pos = cur;
+            continue;
+        }
+
+        if(atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1
+                                                , memory_order_acq_rel
+                                                , memory_order_acquire)) {
+            Xcp_BufferType* b = Xcp_Buffers + (cell & 0xFFu);
+            b->next = NULL;
+            return b;
+        }
+    }
+}
+
+static inline void Xcp_Fifo_Put(Xcp_FifoType* q, Xcp_BufferType* b)
+{
+    unsigned pos = atomic_fetch_add_explicit(&q->tail, 1, memory_order_relaxed);
+    atomic_store_explicit(&q->cell[pos & (XCP_FIFO_SIZE - 1)]
+                        , XCP_FIFO_CELL(pos, (unsigned)(b - Xcp_Buffers))
+                        , memory_order_release);
+}
+
+/**
+ * Look at the front of a fifo without removing it.
+ * Only valid when there is a single reader of the fifo.
+ */
+static inline Xcp_BufferType* Xcp_Fifo_Peek(Xcp_FifoType* q)
+{
+    unsigned pos  = atomic_load_explicit(&q->head, memory_order_acquire);
+    unsigned cell = atomic_load_explicit(&q->cell[pos & (XCP_FIFO_SIZE - 1)], memory_order_acquire);
+    if(!XCP_FIFO_CELL_VALID(cell, pos))
+        return NULL;
+    return Xcp_Buffers + (cell & 0xFFu);
+}
+
+static inline void Xcp_Fifo_Init(Xcp_FifoType* q, Xcp_BufferType* b, Xcp_BufferType* e)
+{
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    for(unsigned i = 0; i < XCP_FIFO_SIZE; i++) {
+        atomic_init(&q->cell[i], 0);
+    }
+    for(;b != e; b++) {
+        b->pool = q;
+        Xcp_Fifo_Put(q, b);
+    }
+}
+
+#else
+
 typedef struct Xcp_FifoType {
     Xcp_BufferType*        front;
     Xcp_BufferType*        back;
     struct Xcp_FifoType*   free;
-    void*                  lock;
+    unsigned int           size; /**< data size of buffers in pool */
+    imask_t                lock;
 } Xcp_FifoType;
 
 static inline void Xcp_Fifo_Lock(Xcp_FifoType* q)
 {
-#if XCP_STANDALONE
-    XcpStandaloneLock();
-#else
-    q->lock = (void*)McuE_EnterCriticalSection();
-#endif
+    q->lock = Xcp_EnterCritical();
 }
 
 static inline void Xcp_Fifo_Unlock(Xcp_FifoType* q)
 {
-#if XCP_STANDALONE
-    XcpStandaloneUnlock();
-#else
-    McuE_ExitCriticalSection((imask_t)q->lock);
-#endif
+    Xcp_ExitCritical(q->lock);
 }
 
 static inline Xcp_BufferType* Xcp_Fifo_Get(Xcp_FifoType* q)
@@ -103,35 +228,70 @@ static inline void Xcp_Fifo_Put(Xcp_FifoType* q, Xcp_BufferType* b)
     Xcp_Fifo_Unlock(q);
 }
 
-static inline void Xcp_Fifo_Put_Front(Xcp_FifoType* q, Xcp_BufferType* b)
+/**
+ * Look at the front of a fifo without removing it.
+ * Only valid when there is a single reader of the fifo.
+ */
+static inline Xcp_BufferType* Xcp_Fifo_Peek(Xcp_FifoType* q)
 {
     Xcp_Fifo_Lock(q);
-    b->next = q->front;
-    q->front = b;
-    if(q->back == NULL)
-        q->back = b;
+    Xcp_BufferType* b = q->front;
     Xcp_Fifo_Unlock(q);
+    return b;
 }
 
+static inline void Xcp_Fifo_Init(Xcp_FifoType* q, Xcp_BufferType* b, Xcp_BufferType* e)
+{
+    q->front = NULL;
+    q->back  = NULL;
+    q->lock  = 0;
+    for(;b != e; b++) {
+        b->pool = q;
+        Xcp_Fifo_Put(q, b);
+    }
+}
+
+#endif
+
+/**
+ * Allocate a buffer of at least size bytes for a traffic class. pool
+ * holds the reserve of the class and links to the shared pools, from
+ * the smallest size up. The shared pools are tried first, in order,
+ * and the reserve only once none of them can provide a buffer.
+ */
+static inline Xcp_BufferType* Xcp_Fifo_Alloc(Xcp_FifoType* pool, unsigned int size)
+{
+    for(Xcp_FifoType* shared = pool->free; shared; shared = shared->free) {
+        if(shared->size < size)
+            continue;
+
+        Xcp_BufferType* b = Xcp_Fifo_Get(shared);
+        if(b)
+            return b;
+    }
+    if(pool->size < size)
+        return NULL;
+    return Xcp_Fifo_Get(pool);
+}
+
+/**
+ * Release a buffer taken from fifo q, it's
+ * always returned to the pool it belongs to.
+ * q may be NULL if fifo is no longer known.
+ */
 static inline void Xcp_Fifo_Free(Xcp_FifoType* q, Xcp_BufferType* b)
 {
     if(b) {
         b->len = 0;
-        Xcp_Fifo_Put(q->free, b);
+        Xcp_Fifo_Put(b->pool, b);
     }
 }
 
-static inline void Xcp_Fifo_Init(Xcp_FifoType* q, Xcp_BufferType* b, Xcp_BufferType* e)
-{
-    q->front = NULL;
-    q->back  = NULL;
-    q->lock  = NULL;
-    for(;b != e; b++)
-        Xcp_Fifo_Put(q, b);
-}
+#define FIFO_GET_WRITE_SIZE(fifo, size, it) \
+    for(Xcp_BufferType* it = Xcp_Fifo_Alloc(fifo.free, size); it; Xcp_Fifo_Put(&fifo, it), it = NULL)
 
-#define FIFO_GET_WRITE(fifo, it) \
-    for(Xcp_BufferType* it = Xcp_Fifo_Get(fifo.free); it; Xcp_Fifo_Put(&fifo, it), it = NULL)
+/* fixed size responses always fit in the minimum CTO of 8 bytes */
+#define FIFO_GET_WRITE(fifo, it) FIFO_GET_WRITE_SIZE(fifo, 8, it)
 
 #define FIFO_FOR_READ(fifo, it) \
     for(Xcp_BufferType* it = Xcp_Fifo_Get(&fifo); it; Xcp_Fifo_Free(&fifo, it), it = Xcp_Fifo_Get(&fifo))
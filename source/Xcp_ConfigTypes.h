@@ -38,6 +38,10 @@ typedef enum {
 #define XCP_IDENTIFICATION_RELATIVE_WORD         0x2
 #define XCP_IDENTIFICATION_RELATIVE_WORD_ALIGNED 0x3
 
+#define XCP_DAQ_OVERLOAD_NONE                    0x0
+#define XCP_DAQ_OVERLOAD_MSB                     0x1
+#define XCP_DAQ_OVERLOAD_EVENT                   0x2
+
 #define XCP_PROTOCOL_TCP     0x1
 #define XCP_PROTOCOL_UDP     0x2
 #define XCP_PROTOCOL_CAN     0x3
@@ -69,6 +73,18 @@ typedef struct {
     const Xcp_PduType* XcpDto2PduMapping; /* XcpRxPdu, XcpTxPdu */
 } Xcp_DtoType;
 
+/**
+ * A single memory copy of a compiled DAQ list
+ *   [INTERNAL]
+ */
+typedef struct {
+            intptr_t    XcpSampleAddress;   /**< source address, a plain pointer if XcpSampleDirect is set */
+            uint8       XcpSampleExtension; /**< address extension used if source can't be read directly */
+            uint8       XcpSampleDirect;    /**< non zero if source can be copied directly from memory */
+            uint8       XcpSampleLength;    /**< number of bytes to copy */
+            uint8       XcpSampleOffset;    /**< destination offset in dto packet, including header */
+} Xcp_SampleType;
+
 typedef struct Xcp_OdtEntryType {
             intptr_t    XcpOdtEntryAddress;
             uint8       XcpOdtEntryLength;
@@ -79,9 +95,17 @@ typedef struct Xcp_OdtEntryType {
      struct Xcp_OdtEntryType *XcpNextOdtEntry;
             uint8       BitOffSet;
             uint8       XcpOdtEntryExtension;
+
+    /**
+     * Compiled sample, valid for the first XcpOdtSampleCount
+     * entries of the ODT's entry array.
+     *   [INTERNAL]
+     */
+            Xcp_SampleType XcpSample;
 } Xcp_OdtEntryType;
 
 struct Xcp_BufferType;
+struct Xcp_FifoType;
 
 typedef struct Xcp_OdtType {
           uint8             XcpMaxOdtEntries;   /* XCP_MAX_ODT_ENTRIES */
@@ -95,6 +119,11 @@ typedef struct Xcp_OdtType {
           int               XcpOdtEntriesValid; /* Number of non zero entries */
    struct Xcp_OdtType      *XcpNextOdt;
    struct Xcp_BufferType   *XcpStim;
+
+          uint8             XcpOdtSampleCount;  /**< Number of compiled samples in entry array */
+          uint8             XcpOdtDirectCount;  /**< Number of compiled samples read directly, ordered first */
+          uint8             XcpOdtLength;       /**< Length of compiled dto packet */
+          uint8             XcpOdtTimestamp;    /**< Compiled dto packet carries timestamp */
 } Xcp_OdtType;
 
 typedef enum {
@@ -119,6 +148,7 @@ typedef struct {
           uint8                   Prescaler;      /* */
           uint8                   Priority;       /* */
           Xcp_DaqListPropertyEnum Properties;     /**< bitfield for the properties of the DAQ list */
+          uint8                   Transport;      /**< index in XcpTransport of transport DTO's are sent on, set to master's by SET_DAQ_LIST_MODE */
 } Xcp_DaqListParams;
 
 
@@ -163,6 +193,27 @@ typedef struct Xcp_DaqListType {
       */
             Xcp_DaqListParams    XcpParams;
 
+     /**
+      * Set when ODT's have been compiled into samples, cleared
+      * when the configuration of the DAQ list changes.
+      *   [INTERNAL]
+      */
+            uint8                XcpCompiled;
+
+     /**
+      * Number of DTO packets dropped since the DAQ list was
+      * cleared due to no free buffers. Saturates at 0xFFFF.
+      *   [INTERNAL]
+      */
+            uint16               XcpOverloadCount;
+
+     /**
+      * Set when a DTO has been dropped and the overload has
+      * not yet been indicated to the master.
+      *   [INTERNAL]
+      */
+            uint8                XcpOverloaded;
+
      /**
       * Pointer to next allocated DAQ list
       *   [INTERNAL]
@@ -176,10 +227,23 @@ typedef struct {
 typedef enum {
     XCP_EVENTCHANNEL_PROPERTY_DAQ         = 1 << 2,
     XCP_EVENTCHANNEL_PROPERTY_STIM        = 1 << 3,
+    XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_DAQ   = 1 << 6, /**< all ODT's of a DAQ list are sampled together */
+    XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_EVENT = 1 << 7, /**< all DAQ lists of the event are sampled together */
     XCP_EVENTCHANNEL_PROPERTY_ALL         = XCP_EVENTCHANNEL_PROPERTY_DAQ
                                           | XCP_EVENTCHANNEL_PROPERTY_STIM,
 } Xcp_EventChannelPropertyEnum;
 
+/**
+ * DTO packet of a consistent sample, allocated up front
+ * so that sampling itself can be done in one go.
+ *   [INTERNAL]
+ */
+typedef struct {
+           Xcp_OdtType*    odt;
+    struct Xcp_BufferType* dto;
+    struct Xcp_FifoType*   fifo;
+} Xcp_DaqSnapshotType;
+
 typedef struct {
     /**
      * Event channel number.
@@ -191,7 +255,10 @@ typedef struct {
 
     /**
      * Priority of event channel (0 .. 255)
-     *   [IGNORED]
+     *   [USER]
+     *
+     * Reported to master in GET_DAQ_EVENT_INFO. Transmit
+     * order is decided by the priority of each DAQ list.
      */
     const  uint8             			XcpEventChannelPriority;
 
@@ -254,9 +321,25 @@ typedef struct {
      */
           uint8                         XcpEventChannelDaqCount;
 
+    /**
+     * Staging area for the DTO packets of one sample
+     *   [USER]
+     *
+     * Required on channels with a CONSISTENCY_DAQ or CONSISTENCY_EVENT
+     * property, NULL otherwise. Packets beyond XcpEventChannelMaxStaging
+     * are dropped as overload, more than XCP_MAX_RXTX_QUEUE are never used.
+     */
+          Xcp_DaqSnapshotType* const    XcpEventChannelStaging;
+
+    /**
+     * Number of entries in XcpEventChannelStaging
+     *   [USER]
+     */
+    const uint8                         XcpEventChannelMaxStaging;
+
 } Xcp_EventChannelType;
 
-enum {
+typedef enum {
     XCP_ACCESS_ECU_ACCESS_WITHOUT_XCP       = 1 << 0,
     XCP_ACCESS_ECU_ACCESS_WITH_XCP          = 1 << 1,
     XCP_ACCESS_XCP_READ_ACCESS_WITHOUT_ECU  = 1 << 2,
@@ -303,8 +386,92 @@ typedef struct {
 
     uint32                 XcpMaxMapping;
     Xcp_MemoryMappingType* XcpMapping;
+
+    uint8                  XcpMode;        /**< segment mode, bit 0 is FREEZE */
+    const intptr_t*        XcpPageAddress; /**< address of each page, XcpMaxPage entries, or NULL if pages are not switched */
+    void**                 XcpEcuPointer;  /**< pointer the ecu accesses the segment through, set to the ecu page, or NULL */
 } Xcp_SegmentType;
 
+/** Address extensions handled by the module itself */
+typedef enum {
+    XCP_MTA_EXTENSION_MEMORY   = 0,
+    XCP_MTA_EXTENSION_FLASH    = 1,
+    XCP_MTA_EXTENSION_DIO_PORT = 2,
+    XCP_MTA_EXTENSION_DIO_CHAN = 3,
+    XCP_MTA_EXTENSION_DEBUG    = 0xFF,
+} Xcp_MtaExtentionType;
+
+/** Memory transfer address, a position in an address extension */
+typedef struct Xcp_MtaType {
+    intptr_t address;
+    uint8    extension;
+    uint32   buffer;   /**< free for use by the extension handler */
+
+    void          (*write)(struct Xcp_MtaType* mta, uint8* data, int len);
+    void          (*read) (struct Xcp_MtaType* mta, uint8* data, int len);
+    void          (*flush)(struct Xcp_MtaType* mta);
+} Xcp_MtaType;
+
+/**
+ * Handler of an address extension, registered with Xcp_MtaRegister.
+ * Read and write advance mta->address by the number of bytes accessed.
+ */
+typedef struct Xcp_MtaExtensionType {
+    /**
+     * Prepare a mta opened at mta->address, may be NULL
+     */
+    void   (*Init)   (Xcp_MtaType* mta);
+
+    /**
+     * Read len bytes, NULL if extension can't be read
+     */
+    void   (*Read)   (Xcp_MtaType* mta, uint8* data, int len);
+
+    /**
+     * Write len bytes, NULL if extension can't be written
+     */
+    void   (*Write)  (Xcp_MtaType* mta, uint8* data, int len);
+
+    /**
+     * Complete any buffered write, may be NULL
+     */
+    void   (*Flush)  (Xcp_MtaType* mta);
+
+    /**
+     * Pointer that reads address directly, as plain memory, or NULL
+     * if it must go through Read. DAQ entries with a direct pointer
+     * are sampled with memcpy. May be NULL.
+     */
+    uint8* (*Pointer)(intptr_t address);
+} Xcp_MtaExtensionType;
+
+struct Xcp_BufferType;
+
+/**
+ * Interface of a transport layer. Each registered transport is
+ * served as its own session, with its own connection state and
+ * queues.
+ */
+typedef struct Xcp_TransportType {
+    /**
+     * Transmit a packet, see XCP_TX_* flags for the return value
+     */
+    Std_ReturnType (*Transmit)         (struct Xcp_BufferType* buf);
+
+    /**
+     * Called after each transmit cycle, to send anything held back
+     */
+    void           (*TransmitFlush)    (void);
+
+    /**
+     * Handle a TRANSPORT_LAYER_CMD from master, or NULL if none are supported
+     */
+    Std_ReturnType (*CmdTransportLayer)(uint8 pid, void* data, int len);
+
+    uint16           MaxCto; /**< largest command packet, at least 8 */
+    uint16           MaxDto; /**< largest data packet, at most XCP_MAX_DTO */
+} Xcp_TransportType;
+
 typedef struct {
     const char* XcpCaption;   /**< ASCII text describing device [USER] */
     const char* XcpMC2File;   /**< ASAM-MC2 filename without path and extension [USER] */
@@ -330,7 +497,7 @@ typedef struct {
     const uint16                     XcpMaxEventChannel;    /* 0 .. 65535, XCP_MAX_EVENT_CHANNEL */
     const uint16                     XcpMinDaq;             /* 0 .. 255  , XCP_MIN_DAQ */
 
-          Xcp_ProtectType            XcpProtect;            /**< Bitfield with currently locked features (Xcp_ProtectType) */
+          Xcp_ProtectType            XcpProtect;            /**< Bitfield with features locked on connect (Xcp_ProtectType) */
 
           /**
            * Function used for Seed & Key unlock
@@ -362,6 +529,15 @@ typedef struct {
            * @return
            */
           Std_ReturnType            (*XcpUserFn)  (void* data, int len);
+
+          /**
+           * Transports to serve, at most XCP_MAX_TRANSPORTS. Leave
+           * XcpTransportCount at 0 to serve all transports built in.
+           */
+    const Xcp_TransportType* const *XcpTransport;
+          uint8                      XcpTransportCount;
+
+          uint8                      XcpChecksumType;       /**< Xcp_ChecksumType of BUILD_CHECKSUM, 0 for XCP_CHECKSUM_ADD_11 */
 } Xcp_ConfigType;
 
 #endif /* XCP_CONFIGTYPES_H_ */
@@ -24,6 +24,7 @@
 #include "Xcp_ByteStream.h"
 #include "Xcp_ConfigTypes.h"
 #include <sys/param.h>
+#include <string.h>
 
 #ifdef XCP_STANDALONE
 #   define USE_DEBUG_PRINTF
@@ -34,12 +35,13 @@
 #   include "XcpStandalone.h"
 #else
 #   include "Os.h"
-#   if(XCP_DEV_ERROR_DETECT)
-#       include "Det.h"
-#   endif
 #   include "ComStack_Types.h"
 #endif
 
+#if(XCP_DEV_ERROR_DETECT)
+#   include "Det.h"
+#endif
+
 #include "debug.h"
 #undef  DEBUG_LVL
 #define DEBUG_LVL DEBUG_HIGH
@@ -233,43 +235,96 @@ typedef struct {
 } Xcp_UnlockType;
 
 
-/* MEMORY READING/WRITING HELPERS */
+/** State of a checksum calculation */
+typedef struct {
+    uint8  type;  /**< Xcp_ChecksumType */
+    uint32 value; /**< checksum so far */
+} Xcp_ChecksumStateType;
 
-typedef enum {
-    XCP_MTA_EXTENSION_MEMORY   = 0,
-    XCP_MTA_EXTENSION_FLASH    = 1,
-    XCP_MTA_EXTENSION_DIO_PORT = 2,
-    XCP_MTA_EXTENSION_DIO_CHAN = 3,
-    XCP_MTA_EXTENSION_DEBUG    = 0xFF,
-} Xcp_MtaExtentionType;
-
-typedef struct Xcp_MtaType {
-    intptr_t address;
-    uint8    extension;
-    uint32   buffer;
-
-    unsigned char (*get)  (struct Xcp_MtaType* mta);
-    void          (*put)  (struct Xcp_MtaType* mta, unsigned char val);
-    void          (*write)(struct Xcp_MtaType* mta, uint8* data, int len);
-    void          (*read) (struct Xcp_MtaType* mta, uint8* data, int len);
-    void          (*flush)(struct Xcp_MtaType* mta);
-} Xcp_MtaType;
+/**
+ * State of the connection to a master over one transport. Each
+ * registered transport is served as its own session.
+ */
+typedef struct {
+    const Xcp_TransportType* transport;
+    int                      connected;
+    Xcp_ProtectType          protect;  /**< features still locked (Xcp_ProtectType) */
+
+    Xcp_FifoType             rx;       /**< received commands */
+    Xcp_FifoType             tx;       /**< command responses and events */
+    Xcp_FifoType             daq[XCP_DAQ_PRIORITY_QUEUES]; /**< DTO packets of each DAQ list priority */
+
+    Xcp_MtaType              mta;
+    Xcp_TransferType         upload;
+    Xcp_TransferType         download;
+    Xcp_CmdWorkType          worker;   /**< command running in background, other commands are answered with ERR_CMD_BUSY */
+    uint16                   pending_cycles; /**< cycles since last EV_CMD_PENDING */
+    Xcp_ChecksumStateType    checksum;
+    uint32                   checksum_rem; /**< bytes left of BUILD_CHECKSUM block */
+#if(XCP_FEATURE_PROTECTION)
+    Xcp_UnlockType           unlock;
+#endif
+
+    uint16                   tx_frames; /**< frames sent in current main function cycle */
+    uint32                   tx_bytes;  /**< packet bytes sent in current main function cycle */
+#if(XCP_TX_RATE_BYTES)
+    uint32                   tx_tokens;
+#endif
+#if(XCP_TX_BUDGET_TIME)
+    TickType                 tx_start;
+#endif
+    volatile uint8           tx_busy;
+    volatile uint8           tx_again;
+} Xcp_SessionType;
 
 /* INTERNAL GLOBAL VARIABLES */
 extern       Xcp_ConfigType    Xcp_Config;
-extern       Xcp_FifoType    Xcp_FifoRx;
-extern       Xcp_FifoType    Xcp_FifoTx;
-extern       Xcp_MtaType       Xcp_Mta;
+extern       Xcp_SessionType   Xcp_Sessions[XCP_MAX_TRANSPORTS];
+extern       uint8             Xcp_SessionCount;
+extern       Xcp_SessionType*  Xcp_Session; /**< session of the command being processed */
 extern       int             Xcp_Inited;
-extern       int             Xcp_Connected;
 
 /* MTA HELPER FUNCTIONS */
+
+/**
+ * Copy memory, reading aligned 1, 2 and 4 byte values with a
+ * single access so a sampled variable is consistent.
+ * @param dst
+ * @param src
+ * @param len
+ */
+static inline void Xcp_MemCopy(uint8* dst, const uint8* src, int len)
+{
+    if(len == 1) {
+        *dst = *src;
+    } else if(len == 2 && ((intptr_t)src & 1) == 0) {
+        uint16 v = *(const volatile uint16*)src;
+        memcpy(dst, &v, 2);
+    } else if(len == 4 && ((intptr_t)src & 3) == 0) {
+        uint32 v = *(const volatile uint32*)src;
+        memcpy(dst, &v, 4);
+    } else {
+        memcpy(dst, src, len);
+    }
+}
+
 void                Xcp_MtaInit (Xcp_MtaType* mta, intptr_t address, uint8 extension);                       /**< Open a new mta reader/writer */
+void                Xcp_MtaAttach(Xcp_MtaType* mta, intptr_t address, uint8 extension);                      /**< Open a new mta reader/writer on a resolved address */
+intptr_t            Xcp_MtaPage (intptr_t address, uint8 extension);                                         /**< Resolve address to the page selected for XCP */
+uint8*              Xcp_MtaReadPointer(intptr_t address, uint8 extension);                                   /**< Direct read pointer or NULL */
+Std_ReturnType      Xcp_MtaCopy (intptr_t dst, intptr_t src, uint32 len, uint8 extension);                  /**< Copy a block within an extension */
 static inline void  Xcp_MtaFlush(Xcp_MtaType* mta)                       { if(mta->flush) mta->flush(mta); } /**< Will flush any remaining data to write */
 static inline void  Xcp_MtaWrite(Xcp_MtaType* mta, uint8* data, int len) { mta->write(mta, data, len); }
 static inline void  Xcp_MtaRead (Xcp_MtaType* mta, uint8* data, int len) { mta->read(mta, data, len);}
-static inline uint8 Xcp_MtaGet  (Xcp_MtaType* mta)                       { return mta->get(mta); }
-static inline void  Xcp_MtaPut  (Xcp_MtaType* mta, uint8 val)            { mta->put(mta, val);}
+static inline uint8 Xcp_MtaGet  (Xcp_MtaType* mta)                       { uint8 val; mta->read(mta, &val, 1); return val; }
+static inline void  Xcp_MtaPut  (Xcp_MtaType* mta, uint8 val)            { mta->write(mta, &val, 1);}
+
+
+/* CHECKSUM CALCULATION */
+uint8  Xcp_ChecksumElement(uint8 type);                                                /**< Element size of checksum, 0 if not supported */
+void   Xcp_ChecksumInit   (Xcp_ChecksumStateType* cs, uint8 type);
+void   Xcp_ChecksumUpdate (Xcp_ChecksumStateType* cs, const uint8* data, uint32 len);
+uint32 Xcp_ChecksumFinal  (Xcp_ChecksumStateType* cs);
 
 
 /* PROGRAMMING COMMANDS */
@@ -282,9 +337,25 @@ Std_ReturnType Xcp_CmdProgramInfo(uint8 pid, void* data, int len);
 
 /* CALLBACK FUNCTIONS */
 
-extern void           Xcp_RxIndication(const void* data, int len);
-extern Std_ReturnType Xcp_Transmit    (const void* data, int len);
-extern Std_ReturnType Xcp_CmdTransportLayer(uint8 pid, void* data, int len);
+extern Xcp_SessionType* Xcp_GetSession(const Xcp_TransportType* transport);
+extern void           Xcp_RxIndication(const Xcp_TransportType* transport, const void* data, int len);
+extern struct Xcp_BufferType* Xcp_RxBorrow(const Xcp_TransportType* transport, uint8 pid, unsigned int size);
+extern void           Xcp_RxCommit    (const Xcp_TransportType* transport, struct Xcp_BufferType* buf);
+extern void           Xcp_RxRelease   (struct Xcp_BufferType* buf);
+extern void           Xcp_TxConfirmation(const Xcp_TransportType* transport);
+
+/* Flags returned by Xcp_TransportType::Transmit when packet was accepted */
+#define XCP_TX_BUFFERED 0x02 /**< no frame was sent, packet was held back to send with following packets */
+#define XCP_TX_RETAINED 0x04 /**< transport keeps the buffer and releases it itself */
+#define XCP_TX_PIPELINED 0x08 /**< transport limits frames in flight and refills using Xcp_TxConfirmation */
+
+/* TRANSPORTS */
+#if(XCP_TRANSPORT_CAN == STD_ON)
+extern const Xcp_TransportType Xcp_TransportCan;
+#endif
+#if(XCP_TRANSPORT_ETH != STD_OFF)
+extern const Xcp_TransportType Xcp_TransportEth;
+#endif
 
 extern void Xcp_TxError(Xcp_ErrorType code);
 extern void Xcp_TxEvent(Xcp_EventType code);
@@ -30,44 +30,59 @@ uint8_t g_XcpDebugMemory[1024];
 #endif
 
 /**
- * Read a character from MTA
+ * Read a buffer from memory
  * @return
  */
-static uint8 Xcp_MtaGetMemory(Xcp_MtaType* mta)
+static void Xcp_MtaReadMemory(Xcp_MtaType* mta, uint8* data, int len)
 {
-    return *(uint8*)(mta->address++);
+    Xcp_MemCopy(data, (const uint8*)mta->address, len);
+    mta->address += len;
 }
 
 /**
- * Read a character from memory
+ * Write a buffer to memory, aligned 2 and 4 byte
+ * values are written with a single access
  * @return
  */
-static void Xcp_MtaReadMemory(Xcp_MtaType* mta, uint8* data, int len)
+static void Xcp_MtaWriteMemory(Xcp_MtaType* mta, uint8* data, int len)
 {
-    memcpy(data, (void*)mta->address, len);
+    if(len == 2 && (mta->address & 1) == 0) {
+        uint16 v;
+        memcpy(&v, data, 2);
+        *(volatile uint16*)mta->address = v;
+    } else if(len == 4 && (mta->address & 3) == 0) {
+        uint32 v;
+        memcpy(&v, data, 4);
+        *(volatile uint32*)mta->address = v;
+    } else {
+        memcpy((void*)mta->address, data, len);
+    }
     mta->address += len;
 }
 
 /**
- * Write a character to memory
- * @return
+ * Memory and flash are read directly at their address
  */
-static void Xcp_MtaWriteMemory(Xcp_MtaType* mta, uint8* data, int len)
+static uint8* Xcp_MtaPointerMemory(intptr_t address)
 {
-    memcpy((void*)mta->address, data, len);
-    mta->address += len;
+    return (uint8*)address;
 }
 
-
+#ifdef XCP_DEBUG_MEMORY
 /**
- * Write a character to MTA
- * @param val
+ * Debug memory starts at address 0 of the extension
  */
-static void Xcp_MtaPutMemory(Xcp_MtaType* mta, uint8 val)
+static void Xcp_MtaInitDebug(Xcp_MtaType* mta)
 {
-    *(uint8*)(mta->address++) = val;
+    mta->address += (intptr_t)g_XcpDebugMemory;
 }
 
+static uint8* Xcp_MtaPointerDebug(intptr_t address)
+{
+    return g_XcpDebugMemory + address;
+}
+#endif
+
 #if(XCP_FEATURE_DIO == STD_ON)
 /**
  * Read a character from DIO
@@ -86,125 +101,322 @@ static uint8 Xcp_MtaGetDioPort(Xcp_MtaType* mta)
 }
 
 /**
- * Flush data in buffer to DIO
+ * If not aligned to start of port, we must fill buffer
+ */
+static void Xcp_MtaInitDioPort(Xcp_MtaType* mta)
+{
+    if(mta->address % sizeof(Dio_PortLevelType)) {
+        mta->buffer = Dio_ReadPort(mta->address / sizeof(Dio_PortLevelType));
+    }
+}
+
+/**
+ * Read a buffer from DIO ports, each port is read once
+ * @return
+ */
+static void Xcp_MtaReadDioPort(Xcp_MtaType* mta, uint8* data, int len)
+{
+    /* finish port already read */
+    while(len > 0 && mta->address % sizeof(Dio_PortLevelType)) {
+        *(data++) = Xcp_MtaGetDioPort(mta);
+        len--;
+    }
+
+    /* whole ports */
+    while(len >= sizeof(Dio_PortLevelType)) {
+        Dio_PortLevelType val = Dio_ReadPort(mta->address / sizeof(Dio_PortLevelType));
+        for(unsigned int i = 0; i < sizeof(Dio_PortLevelType); i++) {
+            *(data++) = (val >> i * 8) & 0xFF;
+        }
+        mta->address += sizeof(Dio_PortLevelType);
+        len          -= sizeof(Dio_PortLevelType);
+    }
+
+    while(len-- > 0) {
+        *(data++) = Xcp_MtaGetDioPort(mta);
+    }
+}
+
+/**
+ * Flush a partially written port in buffer to DIO
  * @return
  */
 static void Xcp_MtaFlushDioPort(Xcp_MtaType* mta)
 {
-    Dio_PortType port = mta->address / sizeof(Dio_PortLevelType);
-    Dio_WritePort(port, mta->buffer);
-    mta->buffer = 0;
+    if(mta->address % sizeof(Dio_PortLevelType)) {
+        Dio_PortType port = mta->address / sizeof(Dio_PortLevelType);
+        Dio_WritePort(port, mta->buffer);
+    }
 }
 
 /**
- * Write a character to DIO
+ * Write a character to DIO, bytes not written
+ * keep the value the port had when started
  * @param val
  */
 static void Xcp_MtaPutDioPort(Xcp_MtaType* mta, uint8 val)
 {
     unsigned int offset = mta->address % sizeof(Dio_PortLevelType);
-    mta->buffer = (mta->buffer & ~(0xFF << offset)) | (val << offset);
-    mta->address++;
+    Dio_PortType port   = mta->address / sizeof(Dio_PortLevelType);
+
     if(offset == 0) {
-        Xcp_MtaFlushDioPort(mta);
+        mta->buffer = Dio_ReadPort(port);
+    }
+    mta->buffer = (mta->buffer & ~(0xFFul << offset * 8)) | ((uint32)val << offset * 8);
+    mta->address++;
+    if(offset == sizeof(Dio_PortLevelType) - 1) {
+        Dio_WritePort(port, mta->buffer);
     }
 }
 
 /**
- * Read a character from a DIO channel
+ * Write a buffer to DIO ports, whole ports
+ * are written without reading them first
  * @return
  */
-static uint8 Xcp_MtaGetDioChan(Xcp_MtaType* mta)
+static void Xcp_MtaWriteDioPort(Xcp_MtaType* mta, uint8* data, int len)
 {
-    if(Dio_ReadChannel(mta->address++) == STD_HIGH)
-        return 1;
-    else
-        return 0;
+    while(len > 0 && mta->address % sizeof(Dio_PortLevelType)) {
+        Xcp_MtaPutDioPort(mta, *(data++));
+        len--;
+    }
+
+    while(len >= sizeof(Dio_PortLevelType)) {
+        Dio_PortLevelType val = 0;
+        for(unsigned int i = 0; i < sizeof(Dio_PortLevelType); i++) {
+            val |= (Dio_PortLevelType)*(data++) << i * 8;
+        }
+        Dio_WritePort(mta->address / sizeof(Dio_PortLevelType), val);
+        mta->address += sizeof(Dio_PortLevelType);
+        len          -= sizeof(Dio_PortLevelType);
+    }
+
+    while(len-- > 0) {
+        Xcp_MtaPutDioPort(mta, *(data++));
+    }
 }
 
 /**
- * Write a character to DIO channel
- * @param val
+ * Read a buffer from consecutive DIO channels
+ * @return
  */
-static void Xcp_MtaPutDioChan(Xcp_MtaType* mta, uint8 val)
+static void Xcp_MtaReadDioChan(Xcp_MtaType* mta, uint8* data, int len)
 {
-    if(val == 1)
-        Dio_WriteChannel(mta->address++, STD_HIGH);
-    else
-        Dio_WriteChannel(mta->address++, STD_LOW);
+    Dio_ChannelType chan = mta->address;
+    while(len-- > 0) {
+        *(data++) = (Dio_ReadChannel(chan++) == STD_HIGH);
+    }
+    mta->address = chan;
+}
+
+/**
+ * Write a buffer to consecutive DIO channels
+ * @return
+ */
+static void Xcp_MtaWriteDioChan(Xcp_MtaType* mta, uint8* data, int len)
+{
+    Dio_ChannelType chan = mta->address;
+    while(len-- > 0) {
+        Dio_WriteChannel(chan++, *(data++) == 1 ? STD_HIGH : STD_LOW);
+    }
+    mta->address = chan;
 }
 
 #endif
 
+static const Xcp_MtaExtensionType Xcp_MtaExtensionMemory = {
+    .Read    = Xcp_MtaReadMemory,
+    .Write   = Xcp_MtaWriteMemory,
+    .Pointer = Xcp_MtaPointerMemory,
+};
+
+static const Xcp_MtaExtensionType Xcp_MtaExtensionFlash = {
+    .Read    = Xcp_MtaReadMemory,
+    .Pointer = Xcp_MtaPointerMemory,
+};
+
+#ifdef XCP_DEBUG_MEMORY
+static const Xcp_MtaExtensionType Xcp_MtaExtensionDebug = {
+    .Init    = Xcp_MtaInitDebug,
+    .Read    = Xcp_MtaReadMemory,
+    .Write   = Xcp_MtaWriteMemory,
+    .Pointer = Xcp_MtaPointerDebug,
+};
+#endif
+
+#if(XCP_FEATURE_DIO == STD_ON)
+static const Xcp_MtaExtensionType Xcp_MtaExtensionDioPort = {
+    .Init    = Xcp_MtaInitDioPort,
+    .Read    = Xcp_MtaReadDioPort,
+    .Write   = Xcp_MtaWriteDioPort,
+    .Flush   = Xcp_MtaFlushDioPort,
+};
+
+static const Xcp_MtaExtensionType Xcp_MtaExtensionDioChan = {
+    .Read    = Xcp_MtaReadDioChan,
+    .Write   = Xcp_MtaWriteDioChan,
+};
+#endif
+
 /**
- * Generic function that writes character to mta using put
- * @param val
+ * Handlers of each address extension, indexed by extension
+ */
+static const Xcp_MtaExtensionType* Xcp_MtaExtensions[256] = {
+    [XCP_MTA_EXTENSION_MEMORY]   = &Xcp_MtaExtensionMemory,
+    [XCP_MTA_EXTENSION_FLASH]    = &Xcp_MtaExtensionFlash,
+#if(XCP_FEATURE_DIO == STD_ON)
+    [XCP_MTA_EXTENSION_DIO_PORT] = &Xcp_MtaExtensionDioPort,
+    [XCP_MTA_EXTENSION_DIO_CHAN] = &Xcp_MtaExtensionDioChan,
+#endif
+#ifdef XCP_DEBUG_MEMORY
+    [XCP_MTA_EXTENSION_DEBUG]    = &Xcp_MtaExtensionDebug,
+#endif
+};
+
+/**
+ * Register handler of an address extension, replacing any handler
+ * registered before. The extensions of the built in handlers are
+ * reserved, whether or not the handler is enabled.
+ * @param extension
+ * @param handler handler to use, must at least provide Read
+ * @return E_NOT_OK if handler is invalid or extension is reserved
  */
-static void Xcp_MtaWriteGeneric(Xcp_MtaType* mta, uint8* data, int len)
+Std_ReturnType Xcp_MtaRegister(uint8 extension, const Xcp_MtaExtensionType* handler)
 {
-    while(len-- > 0) {
-        mta->put(mta, *(data++));    }
+    if(handler == NULL || handler->Read == NULL)
+        return E_NOT_OK;
+
+    if(extension <= XCP_MTA_EXTENSION_DIO_CHAN || extension == XCP_MTA_EXTENSION_DEBUG)
+        return E_NOT_OK;
+
+    Xcp_MtaExtensions[extension] = handler;
+    return E_OK;
 }
 
 /**
- * Generic function that reads buffer from mta using get
- * @param val
+ * Resolve a pointer that can be used to read memory directly, without
+ * going through the mta access functions.
+ * @param address
+ * @param extension
+ * @return pointer to memory, or NULL if extension must be read using a mta
  */
-static void Xcp_MtaReadGeneric(Xcp_MtaType* mta, uint8* data, int len)
+uint8* Xcp_MtaReadPointer(intptr_t address, uint8 extension)
 {
-    while(len-- > 0) {
-        *(data++) = mta->get(mta);
+    const Xcp_MtaExtensionType* handler = Xcp_MtaExtensions[extension];
+    if(handler && handler->Pointer) {
+        return handler->Pointer(address);
     }
+    return NULL;
 }
 
 /**
- * Set the MTA pointer to given address on given extension
+ * Attach the MTA to the handler of given extension,
+ * without any page routing of the address
  * @param address
  * @param extension
  */
-void Xcp_MtaInit(Xcp_MtaType* mta, intptr_t address, uint8 extension)
+void Xcp_MtaAttach(Xcp_MtaType* mta, intptr_t address, uint8 extension)
 {
+    const Xcp_MtaExtensionType* handler = Xcp_MtaExtensions[extension];
+
     mta->address   = address;
     mta->extension = extension;
-    mta->read      = Xcp_MtaReadGeneric;
-    mta->write     = Xcp_MtaWriteGeneric;
-    mta->flush     = NULL;
-
-    if(extension == XCP_MTA_EXTENSION_MEMORY) {
-        mta->get   = Xcp_MtaGetMemory;
-        mta->put   = Xcp_MtaPutMemory;
-        mta->read  = Xcp_MtaReadMemory;
-        mta->write = Xcp_MtaWriteMemory;
-#ifdef XCP_DEBUG_MEMORY
-    } else if(extension == XCP_MTA_EXTENSION_DEBUG) {
-        mta->address = (intptr_t)g_XcpDebugMemory + address;
-        mta->get   = Xcp_MtaGetMemory;
-        mta->put   = Xcp_MtaPutMemory;
-#endif
-    } else if(extension == XCP_MTA_EXTENSION_FLASH) {
-        mta->get   = Xcp_MtaGetMemory;
-        mta->put   = NULL;
-        mta->read  = Xcp_MtaReadGeneric;
-        mta->write = NULL;
-#if(XCP_FEATURE_DIO == STD_ON)
-    } else if(extension == XCP_MTA_EXTENSION_DIO_PORT) {
-        mta->get   = Xcp_MtaGetDioPort;
-        mta->put   = Xcp_MtaPutDioPort;
-        mta->flush = Xcp_MtaFlushDioPort;
-        /* if not aligned to start of port, we must fill buffer */
-        unsigned int offset = address % sizeof(Dio_PortLevelType);
-        mta->address -= offset;
-        while(offset--)
-            Xcp_MtaGetDioPort(mta);
-    } else if(extension == XCP_MTA_EXTENSION_DIO_CHAN) {
-        mta->get   = Xcp_MtaGetDioChan;
-        mta->put   = Xcp_MtaPutDioChan;
-#endif
-    } else {
-        mta->get   = NULL;
-        mta->put   = NULL;
+
+    if(handler == NULL) {
         mta->read  = NULL;
         mta->write = NULL;
+        mta->flush = NULL;
+        return;
+    }
+
+    mta->read  = handler->Read;
+    mta->write = handler->Write;
+    mta->flush = handler->Flush;
+    if(handler->Init) {
+        handler->Init(mta);
+    }
+}
+
+/**
+ * Redirect an address inside a calibration segment to the
+ * same offset of the page selected for XCP access. Segments
+ * are searched linearly, so addresses are resolved once when
+ * set and not on each access.
+ * @param address
+ * @param extension
+ * @return address to access
+ */
+intptr_t Xcp_MtaPage(intptr_t address, uint8 extension)
+{
+#if(XCP_FEATURE_CALPAG)
+    for(uint16 i = 0; i < Xcp_Config.XcpMaxSegment; i++) {
+        const Xcp_SegmentType* seg = Xcp_Config.XcpSegment + i;
+        if(seg->XcpPageAddress == NULL
+        || seg->XcpExtension   != extension
+        || address <  seg->XcpAddress
+        || address >= seg->XcpAddress + (intptr_t)seg->XcpLength) {
+            continue;
+        }
+        return seg->XcpPageAddress[seg->XcpPageXcp] + (address - seg->XcpAddress);
     }
+#endif
+    return address;
 }
 
+/**
+ * Set the MTA pointer to given address on given extension,
+ * addresses inside a calibration segment are accessed on
+ * the page selected for XCP at the time of the call
+ * @param address
+ * @param extension
+ */
+void Xcp_MtaInit(Xcp_MtaType* mta, intptr_t address, uint8 extension)
+{
+    Xcp_MtaAttach(mta, Xcp_MtaPage(address, extension), extension);
+}
+
+/**
+ * Copy a block between two addresses of an extension. The
+ * destination is always written through the bulk write and
+ * flush of the handler, so extensions that need to program
+ * their memory get to do so. A source that can be read
+ * directly is handed to the write as a single block.
+ * No page routing is done on the addresses.
+ * @param dst
+ * @param src
+ * @param len
+ * @param extension
+ * @return E_NOT_OK if extension can't be both read and written
+ */
+Std_ReturnType Xcp_MtaCopy(intptr_t dst, intptr_t src, uint32 len, uint8 extension)
+{
+    const Xcp_MtaExtensionType* handler = Xcp_MtaExtensions[extension];
+    if(handler == NULL || handler->Read == NULL || handler->Write == NULL) {
+        return E_NOT_OK;
+    }
+
+    if(dst == src) {
+        return E_OK;
+    }
+
+    Xcp_MtaType w;
+    Xcp_MtaAttach(&w, dst, extension);
+
+    if(handler->Pointer) {
+        Xcp_MtaWrite(&w, handler->Pointer(src), len);
+        Xcp_MtaFlush(&w);
+        return E_OK;
+    }
+
+    Xcp_MtaType r;
+    uint8       buf[64];
+    Xcp_MtaAttach(&r, src, extension);
+    while(len) {
+        uint32 n = len < sizeof(buf) ? len : sizeof(buf);
+        Xcp_MtaRead (&r, buf, n);
+        Xcp_MtaWrite(&w, buf, n);
+        len -= n;
+    }
+    Xcp_MtaFlush(&w);
+    return E_OK;
+}
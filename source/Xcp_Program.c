@@ -31,13 +31,13 @@ XcpProgramType Xcp_Program;
 Std_ReturnType Xcp_CmdProgramStart(uint8 pid, void* data, int len)
 {
     DEBUG(DEBUG_HIGH, "Received program_start\n");
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         SET_UINT8 (e->data, 0, XCP_PID_RES);
         SET_UINT8 (e->data, 1, 0); /* RESERVED */
         SET_UINT8 (e->data, 2, (!!XCP_FEATURE_BLOCKMODE) << 0 /* MASTER_BLOCK_MODE */
                              | 0 << 1 /* INTERLEAVED_MODE */
                              | (!!XCP_FEATURE_BLOCKMODE) << 6 /* SLAVE_BLOCK_MODE */);
-        SET_UINT8 (e->data, 3, XCP_MAX_CTO); /* MAX_CTO_PGM */
+        SET_UINT8 (e->data, 3, Xcp_Session->transport->MaxCto); /* MAX_CTO_PGM */
         SET_UINT8 (e->data, 4, XCP_MAX_RXTX_QUEUE-1); /* MAX_BS_PGM */
         SET_UINT8 (e->data, 5, 0); /* MIN_ST_PGM [100 microseconds] */
         SET_UINT8 (e->data, 6, XCP_MAX_RXTX_QUEUE-1); /* QUEUE_SIZE_PGM */
@@ -98,7 +98,7 @@ Std_ReturnType Xcp_CmdProgram(uint8 pid, void* data, int len)
     /* check for sequence error */
     if(Xcp_Program.rem != rem) {
         DEBUG(DEBUG_HIGH, "Xcp_CmdProgram - Invalid next state (%u, %u)\n", rem, (unsigned)Xcp_Program.rem);
-        FIFO_GET_WRITE(Xcp_FifoTx, e) {
+        FIFO_GET_WRITE(Xcp_Session->tx, e) {
             SET_UINT8 (e->data, 0, XCP_PID_ERR);
             SET_UINT8 (e->data, 1, XCP_ERR_SEQUENCE);
             SET_UINT8 (e->data, 2, Xcp_Program.rem / XCP_ELEMENT_SIZE);
@@ -145,7 +145,7 @@ typedef enum {
 
 Std_ReturnType Xcp_CmdProgramInfo(uint8 pid, void* data, int len)
 {
-    FIFO_GET_WRITE(Xcp_FifoTx, e) {
+    FIFO_GET_WRITE(Xcp_Session->tx, e) {
         FIFO_ADD_U8 (e, XCP_PID_RES);
         FIFO_ADD_U8 (e, XCP_PGM_PROPERTY_FUNCTIONAL_MODE
                       | XCP_PGM_PROPERTY_NON_SEQ_PGM_SUPPORTED); /* PGM_PROPERTIES */
@@ -0,0 +1,70 @@
+/* Benchmark configuration, shared by the CAN and Ethernet builds.
+ *
+ * Three event channels, the last sampling consistently, DAQ lists are allocated dynamically by the
+ * benchmarks, and one calibration segment with two pages in RAM.
+ */
+
+#include "Xcp.h"
+#include "bench.h"
+
+#define COUNTOF(a) (sizeof(a)/sizeof(*(a)))
+
+static Xcp_DaqListType*    Bench_ChannelDaqList[3][32];
+static Xcp_DaqSnapshotType Bench_Staging[XCP_MAX_RXTX_QUEUE];
+
+static Xcp_EventChannelType Bench_Channels[3] = {
+    {   .XcpEventChannelNumber              = 0
+      , .XcpEventChannelMaxDaqList          = COUNTOF(Bench_ChannelDaqList[0])
+      , .XcpEventChannelTriggeredDaqListRef = Bench_ChannelDaqList[0]
+      , .XcpEventChannelName                = "Fast 1MS"
+      , .XcpEventChannelRate                = 1
+      , .XcpEventChannelUnit                = XCP_TIMESTAMP_UNIT_1MS
+      , .XcpEventChannelProperties          = XCP_EVENTCHANNEL_PROPERTY_ALL
+    },
+    {   .XcpEventChannelNumber              = 1
+      , .XcpEventChannelMaxDaqList          = COUNTOF(Bench_ChannelDaqList[1])
+      , .XcpEventChannelTriggeredDaqListRef = Bench_ChannelDaqList[1]
+      , .XcpEventChannelName                = "Slow 100MS"
+      , .XcpEventChannelRate                = 100
+      , .XcpEventChannelUnit                = XCP_TIMESTAMP_UNIT_1MS
+      , .XcpEventChannelProperties          = XCP_EVENTCHANNEL_PROPERTY_ALL
+    },
+    {   .XcpEventChannelNumber              = 2
+      , .XcpEventChannelMaxDaqList          = COUNTOF(Bench_ChannelDaqList[2])
+      , .XcpEventChannelTriggeredDaqListRef = Bench_ChannelDaqList[2]
+      , .XcpEventChannelName                = "Consistent 1MS"
+      , .XcpEventChannelRate                = 1
+      , .XcpEventChannelUnit                = XCP_TIMESTAMP_UNIT_1MS
+      , .XcpEventChannelProperties          = XCP_EVENTCHANNEL_PROPERTY_ALL
+                                            | XCP_EVENTCHANNEL_PROPERTY_CONSISTENCY_EVENT
+      , .XcpEventChannelStaging             = Bench_Staging
+      , .XcpEventChannelMaxStaging          = COUNTOF(Bench_Staging)
+    },
+};
+
+uint8 Bench_CalPage[2][BENCH_CAL_SIZE];
+void* Bench_CalPointer;
+
+static const intptr_t Bench_CalPages[] = {
+    (intptr_t)Bench_CalPage[0],
+    (intptr_t)Bench_CalPage[1],
+};
+
+static Xcp_SegmentType Bench_Segments[] = {
+    {   .XcpAccessFlags = XCP_ACCESS_ALL
+      , .XcpMaxPage     = COUNTOF(Bench_CalPages)
+      , .XcpAddress     = (intptr_t)Bench_CalPage[0]
+      , .XcpLength      = BENCH_CAL_SIZE
+      , .XcpExtension   = 0
+      , .XcpPageAddress = Bench_CalPages
+      , .XcpEcuPointer  = &Bench_CalPointer
+    },
+};
+
+const Xcp_ConfigType XcpConfig = {
+    .XcpEventChannel    = Bench_Channels
+  , .XcpMaxEventChannel = COUNTOF(Bench_Channels)
+  , .XcpSegment         = Bench_Segments
+  , .XcpMaxSegment      = COUNTOF(Bench_Segments)
+  , .XcpInfo            = { .XcpMC2File = "XcpBench" }
+};
@@ -0,0 +1,373 @@
+/* Host benchmarks of the XCP module, printed as CSV lines of
+ * config,name,value,unit on stdout.
+ */
+
+#include "Xcp.h"
+#include "Xcp_Internal.h"
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint8 Bench_Signals[1024];   /**< sources of DAQ entries */
+static uint8 Bench_Block[1 << 20];  /**< memory uploaded and checksummed */
+
+static void Bench_Connect(void)
+{
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+}
+
+/**
+ * Run main functions until the command running in background is done
+ * @return number of main functions run
+ */
+static unsigned Bench_Finish(void)
+{
+    unsigned calls = 0;
+    for(; Xcp_Session->worker; calls++) {
+        Bench_MainFunction();
+    }
+    return calls;
+}
+
+/**
+ * Allocate dynamic DAQ lists, with odts[n] ODT's in list n,
+ * each holding the same number of entries.
+ */
+static void Bench_DaqAlloc(uint16 lists, const uint8* odts, uint8 entries)
+{
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+    BENCH_OK(0xD5, 0, BENCH_U16(lists));            /* ALLOC_DAQ */
+    for(uint16 daq = 0; daq < lists; daq++) {
+        BENCH_OK(0xD4, 0, BENCH_U16(daq), odts[daq]); /* ALLOC_ODT */
+    }
+    for(uint16 daq = 0; daq < lists; daq++) {
+        for(uint8 odt = 0; odt < odts[daq]; odt++) {
+            BENCH_OK(0xD3, 0, BENCH_U16(daq), odt, entries); /* ALLOC_ODT_ENTRY */
+        }
+    }
+}
+
+/**
+ * Assign a DAQ list to an event channel and select it for sampling
+ */
+static void Bench_DaqMode(uint16 daq, uint16 event, uint8 priority)
+{
+    BENCH_OK(0xE0, 0x00, BENCH_U16(daq), BENCH_U16(event), 1, priority); /* SET_DAQ_LIST_MODE */
+    BENCH_OK(0xDE, 0x02, BENCH_U16(daq));            /* START_STOP_DAQ_LIST, select */
+}
+
+/**
+ * Fill every entry of a DAQ list with size bytes, stride bytes apart
+ * from src, and select it for sampling on an event channel.
+ */
+static void Bench_DaqWrite(uint16 daq, uint8 odts, uint8 entries, uint8 size, uint16 stride,
+                           const uint8* src, uint16 event, uint8 priority)
+{
+    for(uint8 odt = 0; odt < odts; odt++) {
+        BENCH_OK(0xE2, 0, BENCH_U16(daq), odt, 0);   /* SET_DAQ_PTR */
+        for(uint8 entry = 0; entry < entries; entry++) {
+            BENCH_OK(0xE1, 0xFF, size, 0, BENCH_PTR(src)); /* WRITE_DAQ */
+            src += stride;
+        }
+    }
+    Bench_DaqMode(daq, event, priority);
+}
+
+/**
+ * Time of one event on a channel with a DAQ list of 4 ODT's, each
+ * holding 3 separate 2 byte signals. Transmit queues are drained
+ * between batches, outside of the measurement. Run on a normal
+ * channel, then on one sampling the event consistently.
+ */
+static void Bench_DaqEvent(void)
+{
+    enum { odts = 4, entries = 3, batch = 4, events = 200000 };
+    static const struct {
+        uint16      event;
+        const char* name;
+    } channels[] = { { 0, "daq_event" }, { 2, "daq_event_consistent" } };
+
+    for(unsigned c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+        uint16 event = channels[c].event;
+
+        Bench_Connect();
+        Bench_DaqAlloc(1, (const uint8[]){ odts }, entries);
+        Bench_DaqWrite(0, odts, entries, 2, 4, Bench_Signals, event, 0);
+        BENCH_OK(0xDD, 0x01);                       /* START_STOP_SYNCH, start selected */
+
+        uint64_t total = 0;
+        for(int i = 0; i < events; i += batch) {
+            uint64_t t0 = Bench_Now();
+            for(int j = 0; j < batch; j++) {
+                Xcp_MainFunction_Channel(event);
+            }
+            total += Bench_Now() - t0;
+            Bench_MainFunction();
+        }
+        BENCH_OK(0xDD, 0x00);                       /* START_STOP_SYNCH, stop all */
+        Bench_Report(channels[c].name, (double)total / events, "ns/event");
+    }
+}
+
+/**
+ * Configuring signals one byte DAQ entries from scratch, over FREE_DAQ,
+ * ALLOC_DAQ/ODT/ODT_ENTRY, SET_DAQ_PTR and WRITE_DAQ, in lists of 20
+ * ODT's of 5 entries. Run for 100 and 1000 signals, the time per signal
+ * stays flat as long as every lookup is by index.
+ */
+static void Bench_DaqConfigure(void)
+{
+    enum { odts = 20, entries = 5, runs = 50 };
+    static const uint16 counts[] = { 100, 1000 };
+
+    for(unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint16 lists = counts[c] / (odts * entries);
+        uint8  odt_count[1000 / (odts * entries)];
+        memset(odt_count, odts, sizeof(odt_count));
+
+        Bench_Connect();
+        uint64_t t0 = Bench_Now();
+        for(int run = 0; run < runs; run++) {
+            Bench_DaqAlloc(lists, odt_count, entries);
+            for(uint16 daq = 0; daq < lists; daq++) {
+                for(uint8 odt = 0; odt < odts; odt++) {
+                    BENCH_OK(0xE2, 0, BENCH_U16(daq), odt, 0);   /* SET_DAQ_PTR */
+                    for(uint8 entry = 0; entry < entries; entry++) {
+                        BENCH_OK(0xE1, 0xFF, 1, 0, BENCH_PTR(Bench_Signals + entry)); /* WRITE_DAQ */
+                    }
+                }
+            }
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "daq_configure_%u", counts[c]);
+        Bench_Report(name, (double)(Bench_Now() - t0) / runs / counts[c], "ns/signal");
+    }
+}
+
+static uint32 Bench_Cycle;                /**< main function cycle, sampled first in every ODT */
+static uint32 Bench_Latency[2][64];      /**< histogram of cycles from sample to transmit, per list */
+
+/**
+ * Collect the latency of DTO packets carrying Bench_Cycle
+ */
+static void Bench_LatencyPacket(const uint8* data, uint16 len)
+{
+    uint32 cycle;
+    if(data[0] >= 0xFC || len < XCP_DTO_HEADER_SIZE + sizeof(cycle)) {
+        return;
+    }
+    uint16 daq = data[1] | (data[2] << 8);
+    memcpy(&cycle, data + XCP_DTO_HEADER_SIZE, sizeof(cycle));
+    uint32 latency = Bench_Cycle - cycle;
+    if(daq < 2) {
+        Bench_Latency[daq][latency < 63 ? latency : 63]++;
+    }
+}
+
+static void Bench_LatencyReport(const char* mode, const char* list, const uint32* hist)
+{
+    static const struct {
+        const char* name;
+        double      fraction;
+    } percentiles[] = { { "p50", 0.5 }, { "p99", 0.99 }, { "max", 1.0 } };
+
+    uint32 total = 0;
+    for(int i = 0; i < 64; i++) {
+        total += hist[i];
+    }
+    for(unsigned p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++) {
+        uint32 seen = 0, limit = (uint32)(percentiles[p].fraction * total + 0.5);
+        int i = 0;
+        for( ; i < 63 && seen + hist[i] < limit; i++) {
+            seen += hist[i];
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "daq_latency_%s_%s_%s", mode, list, percentiles[p].name);
+        Bench_Report(name, i, "cycles");
+    }
+}
+
+/**
+ * Cycles from sampling to transmission of a fast DAQ list of 1 ODT sent
+ * every cycle, next to a bulk list of 12 ODT's sent every 4th cycle, on
+ * a link taking 5 full DTO's per cycle. The lists share one priority,
+ * then the fast list gets the higher one.
+ */
+static void Bench_DaqLatency(void)
+{
+    enum { cycles = 100000, bulk = 12, link = 5 };
+    static const char* const modes[] = { "shared", "prio" };
+    const uint8 filler = XCP_MAX_ODT_SIZE - sizeof(Bench_Cycle);
+
+    for(uint8 mode = 0; mode < 2; mode++) {
+        Bench_Connect();
+        Bench_DaqAlloc(2, (const uint8[]){ 1, bulk }, 2);
+        for(uint16 daq = 0; daq < 2; daq++) {
+            for(uint8 odt = 0; odt < (daq ? bulk : 1); odt++) {
+                BENCH_OK(0xE2, 0, BENCH_U16(daq), odt, 0);                 /* SET_DAQ_PTR */
+                BENCH_OK(0xE1, 0xFF, sizeof(Bench_Cycle), 0, BENCH_PTR(&Bench_Cycle)); /* WRITE_DAQ */
+                BENCH_OK(0xE1, 0xFF, filler, 0, BENCH_PTR(Bench_Signals));  /* WRITE_DAQ */
+            }
+        }
+        Bench_DaqMode(0, 0, mode);
+        Bench_DaqMode(1, 1, 0);
+        BENCH_OK(0xDD, 0x01);                        /* START_STOP_SYNCH, start selected */
+
+        memset(Bench_Latency, 0, sizeof(Bench_Latency));
+        Bench_Tx.packet = Bench_LatencyPacket;
+        Bench_Tx.budget = link * (BENCH_HEADER + XCP_MAX_DTO);
+        for(Bench_Cycle = 0; Bench_Cycle < cycles; Bench_Cycle++) {
+            if(Bench_Cycle % 4 == 0) {
+                Xcp_MainFunction_Channel(1);
+            }
+            Xcp_MainFunction_Channel(0);
+            Bench_Tx.used = 0;
+            Bench_MainFunction();
+        }
+        Bench_Tx.packet = NULL;
+        Bench_Tx.budget = 0;
+
+        /* flush what the link held back before stopping the lists */
+        for(uint32 frames = ~0u; frames != Bench_Tx.frames; ) {
+            frames = Bench_Tx.frames;
+            Bench_MainFunction();
+        }
+        BENCH_OK(0xDD, 0x00);                        /* START_STOP_SYNCH, stop all */
+
+        Bench_LatencyReport(modes[mode], "fast", Bench_Latency[0]);
+        Bench_LatencyReport(modes[mode], "bulk", Bench_Latency[1]);
+    }
+}
+
+/**
+ * Signal bytes carried per frame, for 16 signals of 4 bytes sampled on
+ * every main function, packed into as few ODT's as the DTO size allows.
+ * Frame bytes include transport headers and CAN FD padding.
+ */
+static void Bench_FrameEfficiency(void)
+{
+    enum { signals = 16, size = 4, events = 1000 };
+    const uint8 entries = XCP_MAX_ODT_SIZE / size;
+    const uint8 odts    = (signals + entries - 1) / entries;
+
+    Bench_Connect();
+    Bench_DaqAlloc(1, &odts, entries);
+    for(uint8 odt = 0; odt < odts; odt++) {
+        BENCH_OK(0xE2, 0, BENCH_U16(0), odt, 0);         /* SET_DAQ_PTR */
+        for(int sig = odt * entries; sig < signals && sig < (odt + 1) * entries; sig++) {
+            BENCH_OK(0xE1, 0xFF, size, 0, BENCH_PTR(Bench_Signals + sig * size)); /* WRITE_DAQ */
+        }
+    }
+    Bench_DaqMode(0, 0, 0);
+    BENCH_OK(0xDD, 0x01);                           /* START_STOP_SYNCH, start selected */
+
+    uint32 frames = Bench_Tx.frames, bytes = Bench_Tx.bytes;
+    for(int i = 0; i < events; i++) {
+        Xcp_MainFunction_Channel(0);
+        Bench_MainFunction();
+    }
+    frames = Bench_Tx.frames - frames;
+    bytes  = Bench_Tx.bytes  - bytes;
+    BENCH_OK(0xDD, 0x00);                           /* START_STOP_SYNCH, stop all */
+
+    Bench_Report("daq_frame_payload", (double)signals * size * events / frames, "bytes/frame");
+    Bench_Report("daq_frame_efficiency", 100.0 * signals * size * events / bytes, "%");
+}
+
+/**
+ * Round trips of SHORT_UPLOAD of 4 bytes
+ */
+static void Bench_CommandRate(void)
+{
+    enum { commands = 200000 };
+
+    Bench_Connect();
+    uint64_t t0 = Bench_Now();
+    for(int i = 0; i < commands; i++) {
+        BENCH_CMD(0xF4, 4, 0, 0, BENCH_PTR(Bench_Signals)); /* SHORT_UPLOAD */
+    }
+    uint64_t t = Bench_Now() - t0;
+    BENCH_OK(0xF4, 4, 0, 0, BENCH_PTR(Bench_Signals));
+    Bench_Report("command", commands * 1e9 / t, "cmds/s");
+}
+
+/**
+ * Block mode upload of 64 kB in UPLOAD commands of 255 bytes, with
+ * the main function cycles it takes under the upload budget of the
+ * configuration
+ */
+static void Bench_Upload(void)
+{
+    enum { size = 0x10000, rounds = 20 };
+
+    Bench_Connect();
+    uint32   frames = Bench_Tx.frames;
+    unsigned cycles = 0;
+    uint64_t t0     = Bench_Now();
+    for(int r = 0; r < rounds; r++) {
+        BENCH_CMD(0xF6, 0, 0, 0, BENCH_PTR(Bench_Block)); /* SET_MTA */
+        for(int left = size; left > 0; left -= 255) {
+            BENCH_CMD(0xF5, left < 255 ? left : 255);    /* UPLOAD */
+            cycles += 1 + Bench_Finish();
+        }
+    }
+    uint64_t t = Bench_Now() - t0;
+    frames = Bench_Tx.frames - frames;
+    Bench_Report("upload", (double)size * rounds * 1e3 / t, "MB/s");
+    Bench_Report("upload_frame_payload", (double)size * rounds / frames, "bytes/frame");
+    Bench_Report("upload_cycles", (double)cycles / rounds, "cycles/64kB");
+    Bench_Report("upload_budget", XCP_UPLOAD_BUDGET_PACKETS, "packets/cycle");
+}
+
+/**
+ * BUILD_CHECKSUM of 1 MB for each checksum type
+ */
+static void Bench_Checksum(void)
+{
+    static const char* const names[] = {
+        [XCP_CHECKSUM_ADD_11]      = "checksum_add_11",
+        [XCP_CHECKSUM_ADD_12]      = "checksum_add_12",
+        [XCP_CHECKSUM_ADD_14]      = "checksum_add_14",
+        [XCP_CHECKSUM_ADD_22]      = "checksum_add_22",
+        [XCP_CHECKSUM_ADD_24]      = "checksum_add_24",
+        [XCP_CHECKSUM_ADD_44]      = "checksum_add_44",
+        [XCP_CHECKSUM_CRC_16]      = "checksum_crc_16",
+        [XCP_CHECKSUM_CRC_16_CITT] = "checksum_crc_16_citt",
+        [XCP_CHECKSUM_CRC_32]      = "checksum_crc_32",
+    };
+    enum { rounds = 10 };
+    const uint32 size = sizeof(Bench_Block);
+
+    Bench_Connect();
+    for(uint8 type = XCP_CHECKSUM_ADD_11; type <= XCP_CHECKSUM_CRC_32; type++) {
+        Xcp_Config.XcpChecksumType = type;
+        uint64_t t0 = Bench_Now();
+        for(int r = 0; r < rounds; r++) {
+            BENCH_CMD(0xF6, 0, 0, 0, BENCH_PTR(Bench_Block)); /* SET_MTA */
+            BENCH_CMD(0xF3, 0, 0, 0, BENCH_U32(size));       /* BUILD_CHECKSUM */
+            Bench_Finish();
+        }
+        uint64_t t = Bench_Now() - t0;
+        Bench_Report(names[type], (double)size * rounds * 1e3 / t, "MB/s");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    for(unsigned i = 0; i < sizeof(Bench_Signals); i++) {
+        Bench_Signals[i] = (uint8)i;
+    }
+    for(unsigned i = 0; i < sizeof(Bench_Block); i++) {
+        Bench_Block[i] = (uint8)(i * 31);
+    }
+
+    Bench_DaqEvent();
+    Bench_DaqConfigure();
+    Bench_DaqLatency();
+    Bench_FrameEfficiency();
+    Bench_CommandRate();
+    Bench_Upload();
+    Bench_Checksum();
+    return 0;
+}
@@ -0,0 +1,86 @@
+/* Host harness for the XCP module.
+ *
+ * Commands are injected through the receive indication of the transport
+ * the harness is built for, and transmitted frames are captured by the
+ * CanIf_Transmit/SoAdIf_Transmit stubs.
+ */
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include "Std_Types.h"
+#include <stdint.h>
+
+#ifndef BENCH_CONFIG
+#define BENCH_CONFIG "host"
+#endif
+
+#define BENCH_CAL_SIZE 256 /**< bytes in each calibration page */
+
+#if(XCP_TRANSPORT_CAN == STD_ON)
+#define BENCH_HEADER 0 /**< transport header in front of each packet */
+#else
+#define BENCH_HEADER 4 /**< transport header in front of each packet */
+#endif
+
+extern uint8 Bench_CalPage[2][BENCH_CAL_SIZE];
+extern void* Bench_CalPointer;
+
+typedef struct {
+    uint32 frames;     /**< frames transmitted */
+    uint32 bytes;      /**< bytes transmitted, including transport headers */
+    uint16 len;        /**< length of last frame */
+    uint8  data[1500]; /**< last frame */
+    uint32 budget;     /**< frame bytes accepted until used is reset, 0 for no limit */
+    uint32 used;       /**< frame bytes accepted against budget */
+    void (*packet)(const uint8* data, uint16 len); /**< called for each transmitted packet, or NULL */
+} Bench_TxType;
+
+extern Bench_TxType Bench_Tx;
+
+/**
+ * Run one main function, then confirm the frames it sent, as the lower
+ * layer would before the next one. On CAN each confirmation refills the
+ * frames in flight, which are then confirmed in turn until no more
+ * frames are sent.
+ */
+void Bench_MainFunction(void);
+
+/**
+ * Pass a command packet to the slave, as received from the master
+ * @param data command packet, starting with the PID
+ * @param len  length of the packet
+ */
+void Bench_Receive(const uint8* data, int len);
+
+/**
+ * Send a command packet to the slave and run Bench_MainFunction
+ * @param data command packet, starting with the PID
+ * @param len  length of the packet
+ * @return first packet of the last frame sent, without transport header
+ */
+const uint8* Bench_Command(const uint8* data, int len);
+
+#define BENCH_CMD(...) ({ const uint8 _d[] = { __VA_ARGS__ }; Bench_Command(_d, sizeof(_d)); })
+
+/**
+ * Stop the harness unless the last command got a positive response
+ * @param res response returned by Bench_Command
+ * @param line source line of the command
+ */
+void Bench_Expect(const uint8* res, int line);
+
+#define BENCH_OK(...) Bench_Expect(BENCH_CMD(__VA_ARGS__), __LINE__)
+
+#define BENCH_U16(v) (uint8)(v), (uint8)((v) >> 8)
+#define BENCH_U32(v) (uint8)(v), (uint8)((v) >> 8), (uint8)((v) >> 16), (uint8)((v) >> 24)
+#define BENCH_PTR(p) BENCH_U32((uint32)(intptr_t)(p))
+
+/** Monotonic time in nanoseconds */
+uint64_t Bench_Now(void);
+
+/**
+ * Print a result as a CSV line: config,name,value,unit
+ */
+void Bench_Report(const char* name, double value, const char* unit);
+
+#endif /* BENCH_H_ */
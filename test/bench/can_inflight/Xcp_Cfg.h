@@ -0,0 +1,32 @@
+/* Benchmark configuration: classic CAN with frames in flight, dynamic DAQ and calibration pages */
+#ifndef XCP_CFG_H_
+#define XCP_CFG_H_
+
+#include "Std_Types.h"
+#include "Xcp_ConfigTypes.h"
+
+#define XCP_STANDALONE
+
+#ifndef XCP_PROTOCOL
+#define XCP_PROTOCOL                XCP_PROTOCOL_CAN
+#endif
+#define XCP_PDU_ID_RX               1
+#define XCP_PDU_ID_TX               2
+#define XCP_COUNTER_ID              0
+#define XCP_E_INIT_FAILED           5
+
+#ifndef XCP_MAX_RXTX_QUEUE
+#define XCP_MAX_RXTX_QUEUE          32
+#endif
+
+#define XCP_FEATURE_DAQSTIM_DYNAMIC STD_ON
+#define XCP_FEATURE_CALPAG          STD_ON
+#define XCP_FEATURE_TRANSMIT_FAST   STD_ON
+#define XCP_CAN_TX_IN_FLIGHT        3
+#define XCP_UPLOAD_BUDGET_PACKETS   0 /* queue whole uploads, so confirmations refill them */
+#define XCP_DAQ_PRIORITY_QUEUES     2
+#define XCP_DAQ_ARENA_SIZE          65536
+
+extern const Xcp_ConfigType XcpConfig;
+
+#endif /* XCP_CFG_H_ */
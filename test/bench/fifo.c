@@ -0,0 +1,342 @@
+/* Stress test and throughput benchmark of the packet fifos, built once
+ * for each backend (linked lists under the lock, lock free rings).
+ *
+ *   fifo_<backend> test   threads, and for the lock free backend a
+ *                         timer signal standing in for an interrupt,
+ *                         passing buffers between two shared fifos,
+ *                         checking that no buffer is lost, handed out
+ *                         twice or reordered, and the order pools
+ *                         are allocated from
+ *   fifo_<backend> bench  transfers through the fifos, as CSV lines
+ *
+ * The list backend locks with the recursive mutex of stubs.c here,
+ * which costs more than the interrupt lock it uses on target.
+ */
+
+#include "Xcp.h"
+#include "Xcp_Internal.h"
+#include "Xcp_ByteStream.h"
+#include "bench.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define FIFO_THREADS_MAX 8
+
+extern Xcp_BufferType Xcp_Buffers[XCP_MAX_RXTX_QUEUE];
+
+static Xcp_FifoType Fifo_Pool;                           /**< free buffers */
+static Xcp_FifoType Fifo_Queue;                          /**< buffers passed from producers to consumers */
+static uint8        Fifo_Data[XCP_MAX_RXTX_QUEUE][8];
+static atomic_uint  Fifo_Owned[XCP_MAX_RXTX_QUEUE];      /**< set while a thread holds the buffer */
+
+static unsigned     Fifo_Producers;
+static unsigned     Fifo_Consumers;
+static unsigned     Fifo_Count;                          /**< transfers per producer */
+static atomic_uint  Fifo_Consumed;
+static atomic_uint  Fifo_Failures;
+
+static void Fifo_Fail(const char* what)
+{
+    if(atomic_fetch_add(&Fifo_Failures, 1) < 10) {
+        fprintf(stderr, "%s: %s\n", BENCH_CONFIG, what);
+    }
+}
+
+/**
+ * Claim a buffer taken from a fifo, fails if another thread holds it
+ */
+static void Fifo_Take(Xcp_BufferType* b)
+{
+    if(atomic_exchange(&Fifo_Owned[b - Xcp_Buffers], 1)) {
+        Fifo_Fail("buffer handed out twice");
+    }
+}
+
+static void Fifo_Give(Xcp_BufferType* b)
+{
+    atomic_store(&Fifo_Owned[b - Xcp_Buffers], 0);
+}
+
+/**
+ * Set up both fifos empty with every buffer in the pool. Lock free
+ * rings are started at position start, with cells holding tags of
+ * the previous lap as if they had been in use, so a test can run
+ * the positions through their wrap around.
+ */
+static void Fifo_Setup(unsigned start)
+{
+    Xcp_Fifo_Init(&Fifo_Pool , NULL, NULL);
+    Xcp_Fifo_Init(&Fifo_Queue, NULL, NULL);
+#if(XCP_FEATURE_FIFO_LOCKFREE)
+    Xcp_FifoType* fifos[] = { &Fifo_Pool, &Fifo_Queue };
+    for(int f = 0; f < 2; f++) {
+        atomic_store(&fifos[f]->head, start);
+        atomic_store(&fifos[f]->tail, start);
+        for(unsigned i = 0; i < XCP_FIFO_SIZE; i++) {
+            unsigned pos = start + i - XCP_FIFO_SIZE;
+            atomic_store(&fifos[f]->cell[pos & (XCP_FIFO_SIZE - 1)], XCP_FIFO_CELL(pos, 0));
+        }
+    }
+#else
+    (void)start;
+#endif
+    for(int i = 0; i < XCP_MAX_RXTX_QUEUE; i++) {
+        Xcp_Buffers[i].data = Fifo_Data[i];
+        Xcp_Buffers[i].pool = &Fifo_Pool;
+        atomic_store(&Fifo_Owned[i], 0);
+        Xcp_Fifo_Put(&Fifo_Pool, Xcp_Buffers + i);
+    }
+    atomic_store(&Fifo_Consumed, 0);
+}
+
+/**
+ * Take a free buffer, stamp it with producer and sequence
+ * number and pass it on to the consumers.
+ * @return 1 if a buffer was sent
+ */
+static int Fifo_Produce(uint8 id, unsigned* seq)
+{
+    Xcp_BufferType* b = Xcp_Fifo_Get(&Fifo_Pool);
+    if(b == NULL) {
+        return 0;
+    }
+    Fifo_Take(b);
+    b->data[0] = id;
+    b->len     = ++*seq;
+    Fifo_Give(b);
+    Xcp_Fifo_Put(&Fifo_Queue, b);
+    return 1;
+}
+
+/**
+ * Receive a buffer, check that the sequence numbers of each producer
+ * arrive in increasing order, then free it.
+ * @param last sequence number last seen from each producer
+ * @return 1 if a buffer was received
+ */
+static int Fifo_Consume(unsigned* last)
+{
+    Xcp_BufferType* b = Xcp_Fifo_Get(&Fifo_Queue);
+    if(b == NULL) {
+        return 0;
+    }
+    Fifo_Take(b);
+    uint8 id = b->data[0];
+    if(id >= Fifo_Producers) {
+        Fifo_Fail("buffer from unknown producer");
+    } else if(b->len <= last[id]) {
+        Fifo_Fail("buffers of a producer out of order");
+    } else {
+        last[id] = b->len;
+    }
+    Fifo_Give(b);
+    Xcp_Fifo_Put(&Fifo_Pool, b);
+    atomic_fetch_add(&Fifo_Consumed, 1);
+    return 1;
+}
+
+static void* Fifo_Producer(void* arg)
+{
+    unsigned seq = 0;
+    while(seq < Fifo_Count) {
+        if(!Fifo_Produce((uint8)(intptr_t)arg, &seq)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void* Fifo_Consumer(void* arg)
+{
+    unsigned last[FIFO_THREADS_MAX] = { 0 };
+    unsigned total = Fifo_Producers * Fifo_Count;
+    while(atomic_load(&Fifo_Consumed) < total) {
+        if(!Fifo_Consume(last)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Every buffer must be back in the pool exactly once, and the queue empty
+ */
+static void Fifo_Check(void)
+{
+    int left = 0;
+    for(Xcp_BufferType* b; (b = Xcp_Fifo_Get(&Fifo_Pool)); left++) {
+        Fifo_Take(b);
+    }
+    if(left != XCP_MAX_RXTX_QUEUE) {
+        Fifo_Fail("buffers lost");
+    }
+    if(Xcp_Fifo_Get(&Fifo_Queue)) {
+        Fifo_Fail("buffers left in queue");
+    }
+}
+
+/**
+ * Pass count buffers from each producer to the consumers
+ * @return time taken in ns
+ */
+static uint64_t Fifo_Run(unsigned producers, unsigned consumers, unsigned count, unsigned start)
+{
+    pthread_t thread[2 * FIFO_THREADS_MAX];
+    int n = 0;
+
+    Fifo_Producers = producers;
+    Fifo_Consumers = consumers;
+    Fifo_Count     = count;
+    Fifo_Setup(start);
+
+    uint64_t t0 = Bench_Now();
+    for(unsigned i = 0; i < consumers; i++) {
+        pthread_create(&thread[n++], NULL, Fifo_Consumer, NULL);
+    }
+    for(unsigned i = 0; i < producers; i++) {
+        pthread_create(&thread[n++], NULL, Fifo_Producer, (void*)(intptr_t)i);
+    }
+    while(n) {
+        pthread_join(thread[--n], NULL);
+    }
+    uint64_t t = Bench_Now() - t0;
+
+    Fifo_Check();
+    return t;
+}
+
+#if(XCP_FEATURE_FIFO_LOCKFREE)
+static unsigned Fifo_IsrSeq;
+static unsigned Fifo_IsrLast[2];
+
+/**
+ * Interrupt, emulated by a timer signal, that produces and consumes
+ * on the fifos the task is using.
+ */
+static void Fifo_Isr(int sig)
+{
+    Fifo_Produce(1, &Fifo_IsrSeq);
+    Fifo_Consume(Fifo_IsrLast);
+}
+
+/**
+ * Task producing and consuming while being interrupted in the middle of
+ * fifo operations. Only the lock free backend is run, the list backend
+ * relies on its lock masking interrupts on target.
+ */
+static void Fifo_RunInterrupted(unsigned count)
+{
+    unsigned seq = 0, last[2] = { 0 };
+    struct itimerval timer = { { 0, 20 }, { 0, 20 } };
+
+    Fifo_Producers = 2;
+    Fifo_Setup(0);
+    Fifo_IsrSeq = 0;
+    memset(Fifo_IsrLast, 0, sizeof(Fifo_IsrLast));
+
+    signal(SIGALRM, Fifo_Isr);
+    setitimer(ITIMER_REAL, &timer, NULL);
+    for(unsigned i = 0; i < count; i++) {
+        Fifo_Produce(0, &seq);
+        Fifo_Consume(last);
+    }
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_REAL, &timer, NULL);
+    signal(SIGALRM, SIG_DFL);
+
+    while(Fifo_Consume(last)) {
+    }
+    Fifo_Check();
+}
+#endif
+
+/**
+ * Allocation must take the smallest fitting shared pool first
+ * and the reserve of the class last
+ */
+static void Fifo_TestAlloc(void)
+{
+    static Xcp_FifoType large   = { .free = NULL  , .size = 64 };
+    static Xcp_FifoType small   = { .free = &large, .size = 8 };
+    static Xcp_FifoType reserve = { .free = &small, .size = 64 };
+    static const struct {
+        unsigned      size;
+        Xcp_FifoType* from[3];
+    } runs[] = {
+        { 8,  { &small, &large, &reserve } },
+        { 16, { &large, &reserve, NULL } },
+    };
+
+    for(unsigned r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        Xcp_Fifo_Init(&large  , Xcp_Buffers + 0, Xcp_Buffers + 1);
+        Xcp_Fifo_Init(&small  , Xcp_Buffers + 1, Xcp_Buffers + 2);
+        Xcp_Fifo_Init(&reserve, Xcp_Buffers + 2, Xcp_Buffers + 3);
+        for(int i = 0; i < 3; i++) {
+            Xcp_BufferType* b = Xcp_Fifo_Alloc(&reserve, runs[r].size);
+            if((b ? b->pool : NULL) != runs[r].from[i]) {
+                Fifo_Fail("allocated from wrong pool");
+            }
+        }
+    }
+}
+
+static int Fifo_Test(void)
+{
+    Fifo_TestAlloc();
+
+    static const struct {
+        unsigned producers, consumers, count, start;
+    } runs[] = {
+        { 1, 1, 1000000, 0 },
+        { 4, 4,  500000, 0 },
+        { 8, 8,  100000, 0 },
+        { 4, 4,  100000, 0u - 1000u }, /* positions wrap during the run */
+    };
+
+    for(unsigned i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        Fifo_Run(runs[i].producers, runs[i].consumers, runs[i].count, runs[i].start);
+    }
+#if(XCP_FEATURE_FIFO_LOCKFREE)
+    Fifo_RunInterrupted(20000000);
+#endif
+
+    unsigned failures = atomic_load(&Fifo_Failures);
+    printf("%s: fifo %s (%u failures)\n", BENCH_CONFIG, failures ? "FAILED" : "OK", failures);
+    return failures != 0;
+}
+
+static int Fifo_Bench(void)
+{
+    enum { count = 10000000 };
+
+    /* uncontended: one thread moving a buffer through both fifos */
+    Fifo_Setup(0);
+    uint64_t t0 = Bench_Now();
+    for(int i = 0; i < count; i++) {
+        Xcp_BufferType* b = Xcp_Fifo_Get(&Fifo_Pool);
+        Xcp_Fifo_Put(&Fifo_Queue, b);
+        b = Xcp_Fifo_Get(&Fifo_Queue);
+        Xcp_Fifo_Put(&Fifo_Pool, b);
+    }
+    Bench_Report("fifo_single", (double)(Bench_Now() - t0) / count, "ns/transfer");
+
+    uint64_t t = Fifo_Run(1, 1, count / 4, 0);
+    Bench_Report("fifo_spsc", count / 4 * 1e9 / t, "transfers/s");
+
+    t = Fifo_Run(4, 4, count / 16, 0);
+    Bench_Report("fifo_mpmc_4x4", count / 4 * 1e9 / t, "transfers/s");
+    return atomic_load(&Fifo_Failures) != 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return Fifo_Bench();
+    }
+    return Fifo_Test();
+}
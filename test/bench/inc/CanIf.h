@@ -0,0 +1,11 @@
+/* CanIf stub, transmitted frames are captured by the harness */
+#ifndef CANIF_H
+#define CANIF_H
+
+#include "ComStack_Types.h"
+
+typedef uint32 Can_IdType;
+
+Std_ReturnType CanIf_Transmit(PduIdType id, const PduInfoType* pdu);
+
+#endif /* CANIF_H */
@@ -0,0 +1,14 @@
+/* Minimal AUTOSAR communication stack types for host builds */
+#ifndef COMSTACK_TYPES_H
+#define COMSTACK_TYPES_H
+
+#include "Std_Types.h"
+
+typedef uint16 PduIdType;
+
+typedef struct {
+    uint8* SduDataPtr;
+    uint16 SduLength;
+} PduInfoType;
+
+#endif /* COMSTACK_TYPES_H */
@@ -0,0 +1,17 @@
+/* Dio stub, ports read back a fixed pattern */
+#ifndef DIO_H
+#define DIO_H
+
+#include "Std_Types.h"
+
+typedef uint32 Dio_PortLevelType;
+typedef uint8  Dio_PortType;
+typedef uint16 Dio_ChannelType;
+typedef uint8  Dio_LevelType;
+
+Dio_PortLevelType Dio_ReadPort    (Dio_PortType port);
+void              Dio_WritePort   (Dio_PortType port, Dio_PortLevelType level);
+Dio_LevelType     Dio_ReadChannel (Dio_ChannelType channel);
+void              Dio_WriteChannel(Dio_ChannelType channel, Dio_LevelType level);
+
+#endif /* DIO_H */
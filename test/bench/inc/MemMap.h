@@ -0,0 +1 @@
+/* Memory sections are not used on host */
@@ -0,0 +1,9 @@
+/* SoAdIf stub, transmitted frames are captured by the harness */
+#ifndef SOADIF_H
+#define SOADIF_H
+
+#include "ComStack_Types.h"
+
+Std_ReturnType SoAdIf_Transmit(PduIdType id, const PduInfoType* pdu);
+
+#endif /* SOADIF_H */
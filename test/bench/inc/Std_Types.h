@@ -0,0 +1,26 @@
+/* Minimal AUTOSAR standard types for host builds of the XCP module */
+#ifndef STD_TYPES_H
+#define STD_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+
+typedef uint8    Std_ReturnType;
+
+#define E_OK     0
+#define E_NOT_OK 1
+
+#define STD_ON   1
+#define STD_OFF  0
+
+#define STD_HIGH 1
+#define STD_LOW  0
+
+#endif /* STD_TYPES_H */
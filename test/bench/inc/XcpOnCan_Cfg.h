@@ -0,0 +1 @@
+/* No transport specific configuration needed on host */
@@ -0,0 +1,18 @@
+/* Operating system services used by the XCP module in standalone mode */
+#ifndef XCPSTANDALONE_H
+#define XCPSTANDALONE_H
+
+#include "Std_Types.h"
+
+typedef uint32  TickType;
+typedef int     CounterType;
+typedef uint32* TickRefType;
+typedef int     StatusType;
+typedef int     imask_t;
+
+StatusType GetCounterValue(CounterType counter, TickRefType tick);
+
+void XcpStandaloneLock(void);
+void XcpStandaloneUnlock(void);
+
+#endif /* XCPSTANDALONE_H */
@@ -0,0 +1,8 @@
+/* Debug output is compiled out of benchmark builds */
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#define DEBUG_HIGH 1
+#define DEBUG(level, ...) do { } while(0)
+
+#endif /* DEBUG_H */
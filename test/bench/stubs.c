@@ -0,0 +1,172 @@
+/* Stubs of the AUTOSAR services the XCP module uses, and the
+ * transport side of the harness.
+ */
+
+#define _GNU_SOURCE
+#include "Xcp.h"
+#include "bench.h"
+#include "CanIf.h"
+#include "SoAdIf.h"
+#include "Dio.h"
+#include "XcpStandalone.h"
+#include "Xcp_Internal.h"
+#if(XCP_TRANSPORT_CAN == STD_ON)
+#include "XcpOnCan_Cbk.h"
+#endif
+#if(XCP_TRANSPORT_ETH != STD_OFF)
+#include "XcpOnEth_Cbk.h"
+#endif
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+Bench_TxType Bench_Tx;
+
+static unsigned Bench_TxUnconfirmed; /**< frames accepted, not yet confirmed to the module */
+
+static pthread_mutex_t Bench_Lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void XcpStandaloneLock(void)
+{
+    pthread_mutex_lock(&Bench_Lock);
+}
+
+void XcpStandaloneUnlock(void)
+{
+    pthread_mutex_unlock(&Bench_Lock);
+}
+
+StatusType GetCounterValue(CounterType counter, TickRefType tick)
+{
+    *tick = (TickType)(Bench_Now() / 1000000u);
+    return 0;
+}
+
+/**
+ * Accept a frame within the budget and keep a copy of it
+ * @param header bytes of transport header in front of each packet,
+ *        packets are split on it when header is not 0
+ */
+static Std_ReturnType Bench_Capture(const PduInfoType* pdu, uint16 header)
+{
+    if(Bench_Tx.budget && Bench_Tx.used + pdu->SduLength > Bench_Tx.budget) {
+        return E_NOT_OK;
+    }
+    Bench_Tx.used += pdu->SduLength;
+
+    uint16 len = pdu->SduLength;
+    if(len > sizeof(Bench_Tx.data)) {
+        len = sizeof(Bench_Tx.data);
+    }
+    memcpy(Bench_Tx.data, pdu->SduDataPtr, len);
+    Bench_Tx.len    = len;
+    Bench_Tx.bytes += pdu->SduLength;
+    Bench_Tx.frames++;
+    Bench_TxUnconfirmed++;
+
+    if(Bench_Tx.packet) {
+        const uint8* data = pdu->SduDataPtr;
+        uint16       left = pdu->SduLength;
+        while(left > header) {
+            uint16 n = header ? (data[0] | (data[1] << 8)) : left;
+            if(header + n > left) {
+                break;
+            }
+            Bench_Tx.packet(data + header, n);
+            data += header + n;
+            left -= header + n;
+        }
+    }
+    return E_OK;
+}
+
+Std_ReturnType CanIf_Transmit(PduIdType id, const PduInfoType* pdu)
+{
+    return Bench_Capture(pdu, 0);
+}
+
+Std_ReturnType SoAdIf_Transmit(PduIdType id, const PduInfoType* pdu)
+{
+    return Bench_Capture(pdu, 4);
+}
+
+Dio_PortLevelType Dio_ReadPort(Dio_PortType port)
+{
+    return 0x11223344u + port;
+}
+
+void Dio_WritePort(Dio_PortType port, Dio_PortLevelType level)
+{
+}
+
+Dio_LevelType Dio_ReadChannel(Dio_ChannelType channel)
+{
+    return channel & 1;
+}
+
+void Dio_WriteChannel(Dio_ChannelType channel, Dio_LevelType level)
+{
+}
+
+void Bench_MainFunction(void)
+{
+    Xcp_MainFunction();
+    while(Bench_TxUnconfirmed) {
+        Bench_TxUnconfirmed--;
+#if(XCP_TRANSPORT_CAN == STD_ON)
+        Xcp_CanIfTxConfirmation(XCP_CAN_PDU_ID_TX);
+#else
+        Xcp_SoAdIfTxConfirmation(XCP_ETH_PDU_ID_TX);
+#endif
+    }
+}
+
+void Bench_Receive(const uint8* data, int len)
+{
+#if(XCP_TRANSPORT_CAN == STD_ON)
+    PduInfoType pdu = { (uint8*)data, len };
+    Xcp_CanIfRxIndication(XCP_CAN_PDU_ID_RX, &pdu);
+#else
+    static uint16 ctr;
+    uint8 frame[4 + XCP_MAX_CTO];
+    frame[0] = (uint8)len;
+    frame[1] = (uint8)(len >> 8);
+    frame[2] = (uint8)ctr;
+    frame[3] = (uint8)(ctr >> 8);
+    ctr++;
+    memcpy(frame + 4, data, len);
+    PduInfoType pdu = { frame, 4 + len };
+    Xcp_SoAdIfRxIndication(XCP_ETH_PDU_ID_RX, &pdu);
+#endif
+}
+
+const uint8* Bench_Command(const uint8* data, int len)
+{
+    Bench_Receive(data, len);
+    Bench_Tx.len = 0;
+    Bench_MainFunction();
+    return Bench_Tx.data + BENCH_HEADER;
+}
+
+void Bench_Expect(const uint8* res, int line)
+{
+    if(Bench_Tx.len == 0 || res[0] != XCP_PID_RES) {
+        fprintf(stderr, "%s: command on line %d failed (%02x %02x)\n", BENCH_CONFIG, line,
+                Bench_Tx.len ? res[0] : 0, Bench_Tx.len ? res[1] : 0);
+        exit(1);
+    }
+}
+
+uint64_t Bench_Now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+void Bench_Report(const char* name, double value, const char* unit)
+{
+    printf("%s,%s,%.1f,%s\n", BENCH_CONFIG, name, value, unit);
+}
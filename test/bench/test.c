@@ -0,0 +1,412 @@
+/* Host tests of the XCP module, run for each configuration.
+ *
+ * Each check prints what failed on stderr, the program exits non zero
+ * if any did.
+ */
+
+#include "Xcp.h"
+#include "Xcp_Internal.h"
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+
+static unsigned Test_Failures;
+
+#define TEST_CHECK(cond) Test_Check((cond), #cond, __LINE__)
+
+static void Test_Check(int ok, const char* what, int line)
+{
+    if(!ok) {
+        fprintf(stderr, "%s: line %d: %s\n", BENCH_CONFIG, line, what);
+        Test_Failures++;
+    }
+}
+
+static uint8 Test_Memory[16];
+
+static void Test_MtaRead(Xcp_MtaType* mta, uint8* data, int len)
+{
+    memcpy(data, Test_Memory + mta->address, len);
+    mta->address += len;
+}
+
+static void Test_MtaReadInverted(Xcp_MtaType* mta, uint8* data, int len)
+{
+    while(len-- > 0) {
+        *(data++) = ~Test_Memory[mta->address++];
+    }
+}
+
+/**
+ * Invalid handlers and the extensions of the built in handlers are
+ * refused, other extensions can be registered and replaced.
+ */
+static void Test_MtaRegister(void)
+{
+    static const Xcp_MtaExtensionType plain    = { .Read = Test_MtaRead };
+    static const Xcp_MtaExtensionType inverted = { .Read = Test_MtaReadInverted };
+    static const Xcp_MtaExtensionType noread   = { .Write = NULL };
+    static const uint8 reserved[] = { 0x00, 0x01, 0x02, 0x03, 0xFF };
+
+    TEST_CHECK(Xcp_MtaRegister(0x10, NULL)    == E_NOT_OK);
+    TEST_CHECK(Xcp_MtaRegister(0x10, &noread) == E_NOT_OK);
+    for(unsigned i = 0; i < sizeof(reserved); i++) {
+        TEST_CHECK(Xcp_MtaRegister(reserved[i], &plain) == E_NOT_OK);
+    }
+
+    for(unsigned i = 0; i < sizeof(Test_Memory); i++) {
+        Test_Memory[i] = (uint8)(0x40 + i);
+    }
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+
+    TEST_CHECK(Xcp_MtaRegister(0x10, &plain) == E_OK);
+    const uint8* res = BENCH_CMD(0xF4, 2, 0, 0x10, 4, 0, 0, 0); /* SHORT_UPLOAD */
+    TEST_CHECK(res[0] == XCP_PID_RES && res[1] == 0x44 && res[2] == 0x45);
+
+    TEST_CHECK(Xcp_MtaRegister(0x10, &inverted) == E_OK);
+    res = BENCH_CMD(0xF4, 2, 0, 0x10, 4, 0, 0, 0);  /* SHORT_UPLOAD */
+    TEST_CHECK(res[0] == XCP_PID_RES && res[1] == 0xBB && res[2] == 0xBA);
+
+    /* memory extension still served by the built in handler */
+    res = BENCH_CMD(0xF4, 1, 0, 0x00, BENCH_PTR(Test_Memory));  /* SHORT_UPLOAD */
+    TEST_CHECK(res[0] == XCP_PID_RES && res[1] == 0x40);
+}
+
+/**
+ * BUILD_CHECKSUM of each type against known answers: the CRC check
+ * values of "123456789", and additions overflowing their result so
+ * they are truncated to its size. Additions of words and double words
+ * add them in the byte order of the slave, and refuse blocks that are
+ * not a multiple of their size.
+ */
+static void Test_Checksum(void)
+{
+    static const uint8 digits[] = "123456789";
+    static const uint8 ones[8]  = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    static const struct {
+        uint8        type;
+        const uint8* data;
+        uint32       size;
+        uint32       checksum;
+    } kats[] = {
+        { XCP_CHECKSUM_CRC_16,      digits, 9, 0xBB3D     },
+        { XCP_CHECKSUM_CRC_16_CITT, digits, 9, 0x29B1     },
+        { XCP_CHECKSUM_CRC_32,      digits, 9, 0xCBF43926 },
+        { XCP_CHECKSUM_ADD_11,      digits, 9, 0xDD       },
+        { XCP_CHECKSUM_ADD_12,      digits, 9, 0x01DD     },
+        { XCP_CHECKSUM_ADD_14,      digits, 9, 0x01DD     },
+        { XCP_CHECKSUM_ADD_22,      digits, 8, 0xD4D0     },
+        { XCP_CHECKSUM_ADD_24,      digits, 8, 0xD4D0     },
+        { XCP_CHECKSUM_ADD_44,      digits, 8, 0x6C6A6866 },
+        { XCP_CHECKSUM_ADD_11,      ones,   8, 0xF8       },
+        { XCP_CHECKSUM_ADD_12,      ones,   8, 0x07F8     },
+        { XCP_CHECKSUM_ADD_14,      ones,   8, 0x07F8     },
+        { XCP_CHECKSUM_ADD_22,      ones,   8, 0xFFFC     },
+        { XCP_CHECKSUM_ADD_24,      ones,   8, 0x0003FFFC },
+        { XCP_CHECKSUM_ADD_44,      ones,   8, 0xFFFFFFFE },
+    };
+    static const uint8 unaligned[][2] = {
+        { XCP_CHECKSUM_ADD_22, 9 },
+        { XCP_CHECKSUM_ADD_24, 9 },
+        { XCP_CHECKSUM_ADD_44, 6 },
+    };
+
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+
+    for(unsigned i = 0; i < sizeof(kats) / sizeof(kats[0]); i++) {
+        Xcp_Config.XcpChecksumType = kats[i].type;
+        BENCH_OK(0xF6, 0, 0, 0, BENCH_PTR(kats[i].data));        /* SET_MTA */
+        const uint8* res = BENCH_CMD(0xF3, 0, 0, 0, BENCH_U32(kats[i].size)); /* BUILD_CHECKSUM */
+        if(res[0] != XCP_PID_RES || res[1] != kats[i].type || GET_UINT32(res, 4) != kats[i].checksum) {
+            fprintf(stderr, "%s: checksum type %u of %u bytes is %08x, expected %08x\n", BENCH_CONFIG,
+                    kats[i].type, (unsigned)kats[i].size, (unsigned)GET_UINT32(res, 4), (unsigned)kats[i].checksum);
+            Test_Failures++;
+        }
+    }
+
+    for(unsigned i = 0; i < sizeof(unaligned) / sizeof(unaligned[0]); i++) {
+        Xcp_Config.XcpChecksumType = unaligned[i][0];
+        BENCH_OK(0xF6, 0, 0, 0, BENCH_PTR(digits));                 /* SET_MTA */
+        const uint8* res = BENCH_CMD(0xF3, 0, 0, 0, BENCH_U32(unaligned[i][1])); /* BUILD_CHECKSUM */
+        TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_OUT_OF_RANGE);
+    }
+    Xcp_Config.XcpChecksumType = XcpConfig.XcpChecksumType;
+}
+
+static uint8 Test_Last[8];
+
+static void Test_LastPacket(const uint8* data, uint16 len)
+{
+    memset(Test_Last, 0, sizeof(Test_Last));
+    memcpy(Test_Last, data, len < sizeof(Test_Last) ? len : sizeof(Test_Last));
+}
+
+/**
+ * BUILD_CHECKSUM of a block over the budget runs in background: the
+ * master is told with EV_CMD_PENDING, other commands are answered
+ * with ERR_CMD_BUSY until the result is sent, and SYNCH, DISCONNECT
+ * and CONNECT abort it.
+ */
+static void Test_Pending(void)
+{
+    static const uint8 block[3 * XCP_CHECKSUM_BUDGET];
+    static const uint8 aborts[][2] = {
+        { 0xFC, 0x00 },                             /* SYNCH */
+        { 0xFE, 0x00 },                             /* DISCONNECT */
+        { 0xFF, 0x00 },                             /* CONNECT */
+    };
+
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    Xcp_Config.XcpChecksumType = XCP_CHECKSUM_ADD_14;
+
+    BENCH_OK(0xF6, 0, 0, 0, BENCH_PTR(block));      /* SET_MTA */
+    const uint8* res = BENCH_CMD(0xF3, 0, 0, 0, BENCH_U32(sizeof(block))); /* BUILD_CHECKSUM */
+    TEST_CHECK(res[0] == XCP_PID_EV && res[1] == XCP_EV_CMD_PENDING);
+
+    res = BENCH_CMD(0xFD);                          /* GET_STATUS */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_CMD_BUSY);
+
+    Bench_Tx.packet = Test_LastPacket;
+    while(Xcp_Session->worker) {
+        Bench_MainFunction();
+    }
+    Bench_Tx.packet = NULL;
+    TEST_CHECK(Test_Last[0] == XCP_PID_RES && Test_Last[1] == XCP_CHECKSUM_ADD_14 && GET_UINT32(Test_Last, 4) == 0);
+
+    BENCH_OK(0xFD);                                 /* GET_STATUS */
+
+    for(unsigned i = 0; i < sizeof(aborts) / sizeof(aborts[0]); i++) {
+        BENCH_OK(0xFF, 0x00);                       /* CONNECT */
+        BENCH_OK(0xF6, 0, 0, 0, BENCH_PTR(block));  /* SET_MTA */
+        BENCH_CMD(0xF3, 0, 0, 0, BENCH_U32(sizeof(block))); /* BUILD_CHECKSUM */
+        res = BENCH_CMD(aborts[i][0], aborts[i][1]);
+        TEST_CHECK(Xcp_Session->worker == NULL);
+        TEST_CHECK(aborts[i][0] == 0xFC ? res[0] == XCP_PID_ERR && res[1] == XCP_ERR_CMD_SYNCH
+                                        : res[0] == XCP_PID_RES);
+    }
+
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    BENCH_OK(0xFD);                                 /* GET_STATUS */
+    Xcp_Config.XcpChecksumType = XcpConfig.XcpChecksumType;
+}
+
+static uint8 Test_Dto[XCP_DTO_HEADER_SIZE + 1];
+
+static void Test_DtoPacket(const uint8* data, uint16 len)
+{
+    if(data[0] < XCP_PID_SERV && len >= sizeof(Test_Dto)) {
+        memcpy(Test_Dto, data, sizeof(Test_Dto));
+    }
+}
+
+/**
+ * Switching the XCP page redirects uploads and running DAQ lists
+ * sampling inside the segment, COPY_CAL_PAGE copies whole pages
+ * and refuses destinations XCP has no write access to.
+ */
+static void Test_CalPage(void)
+{
+    Xcp_SegmentType readonly = {
+        .XcpAccessFlags = XCP_ACCESS_XCP_READ_ACCESS_WITHOUT_ECU
+      , .XcpMaxPage     = 2
+      , .XcpAddress     = (intptr_t)Bench_CalPage[0]
+      , .XcpLength      = BENCH_CAL_SIZE
+      , .XcpPageAddress = XcpConfig.XcpSegment[0].XcpPageAddress
+    };
+
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    Bench_CalPage[0][0] = 0x11;
+    Bench_CalPage[1][0] = 0x22;
+
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+    BENCH_OK(0xD5, 0, BENCH_U16(1));                /* ALLOC_DAQ */
+    BENCH_OK(0xD4, 0, BENCH_U16(0), 1);             /* ALLOC_ODT */
+    BENCH_OK(0xD3, 0, BENCH_U16(0), 0, 1);          /* ALLOC_ODT_ENTRY */
+    BENCH_OK(0xE2, 0, BENCH_U16(0), 0, 0);          /* SET_DAQ_PTR */
+    BENCH_OK(0xE1, 0xFF, 1, 0, BENCH_PTR(Bench_CalPage[0])); /* WRITE_DAQ */
+    BENCH_OK(0xE0, 0x00, BENCH_U16(0), BENCH_U16(0), 1, 0);  /* SET_DAQ_LIST_MODE */
+    BENCH_OK(0xDE, 0x01, BENCH_U16(0));             /* START_STOP_DAQ_LIST, start */
+
+    Bench_Tx.packet = Test_DtoPacket;
+    Xcp_MainFunction_Channel(0);
+    Bench_MainFunction();
+    TEST_CHECK(Test_Dto[XCP_DTO_HEADER_SIZE] == 0x11);
+
+    BENCH_OK(0xEB, 0x02, 0, 1);                     /* SET_CAL_PAGE, xcp page 1 */
+    Xcp_MainFunction_Channel(0);
+    Bench_MainFunction();
+    TEST_CHECK(Test_Dto[XCP_DTO_HEADER_SIZE] == 0x22);
+    Bench_Tx.packet = NULL;
+    BENCH_OK(0xDD, 0x00);                           /* START_STOP_SYNCH, stop all */
+
+    const uint8* res = BENCH_CMD(0xF4, 1, 0, 0, BENCH_PTR(Bench_CalPage[0])); /* SHORT_UPLOAD */
+    TEST_CHECK(res[0] == XCP_PID_RES && res[1] == 0x22);
+
+    BENCH_OK(0xE4, 0, 0, 0, 1);                     /* COPY_CAL_PAGE, page 0 to 1 */
+    TEST_CHECK(Bench_CalPage[1][0] == 0x11);
+
+    Bench_CalPage[1][0] = 0x22;
+    Xcp_Config.XcpSegment = &readonly;
+    res = BENCH_CMD(0xE4, 0, 0, 0, 1);              /* COPY_CAL_PAGE, page 0 to 1 */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_WRITE_PROTECTED);
+    TEST_CHECK(Bench_CalPage[1][0] == 0x22);
+    Xcp_Config.XcpSegment = XcpConfig.XcpSegment;
+
+    BENCH_OK(0xEB, 0x83, 0, 0);                     /* SET_CAL_PAGE, all segments page 0 */
+}
+
+/**
+ * MAX_DAQ of GET_DAQ_PROCESSOR_INFO after FREE_DAQ can be allocated,
+ * with an ODT of one entry in each list. ALLOC_DAQ, and ALLOC_ODT or
+ * ALLOC_ODT_ENTRY on the same list or ODT, are refused when repeated.
+ */
+static void Test_DaqAlloc(void)
+{
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+
+    const uint8* res = BENCH_CMD(0xDA);             /* GET_DAQ_PROCESSOR_INFO */
+    uint16 lists = GET_UINT16(res, 2);
+    TEST_CHECK(res[0] == XCP_PID_RES && lists > 0);
+
+    res = BENCH_CMD(0xD5, 0, BENCH_U16(lists));     /* ALLOC_DAQ */
+    TEST_CHECK(res[0] == XCP_PID_RES);
+    for(uint16 daq = 0; daq < lists; daq++) {
+        res = BENCH_CMD(0xD4, 0, BENCH_U16(daq), 1); /* ALLOC_ODT */
+        TEST_CHECK(res[0] == XCP_PID_RES);
+    }
+    for(uint16 daq = 0; daq < lists; daq++) {
+        res = BENCH_CMD(0xD3, 0, BENCH_U16(daq), 0, 1); /* ALLOC_ODT_ENTRY */
+        TEST_CHECK(res[0] == XCP_PID_RES);
+    }
+
+    res = BENCH_CMD(0xDA);                          /* GET_DAQ_PROCESSOR_INFO */
+    TEST_CHECK(res[0] == XCP_PID_RES && GET_UINT16(res, 2) == lists);
+
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+    BENCH_OK(0xD5, 0, BENCH_U16(2));                /* ALLOC_DAQ */
+    res = BENCH_CMD(0xD5, 0, BENCH_U16(2));         /* ALLOC_DAQ */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_SEQUENCE);
+
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+    BENCH_OK(0xD5, 0, BENCH_U16(2));                /* ALLOC_DAQ */
+    BENCH_OK(0xD4, 0, BENCH_U16(0), 1);             /* ALLOC_ODT */
+    res = BENCH_CMD(0xD4, 0, BENCH_U16(0), 1);      /* ALLOC_ODT */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_SEQUENCE);
+    BENCH_OK(0xD4, 0, BENCH_U16(1), 1);             /* ALLOC_ODT */
+    BENCH_OK(0xD3, 0, BENCH_U16(0), 0, 1);          /* ALLOC_ODT_ENTRY */
+    res = BENCH_CMD(0xD3, 0, BENCH_U16(0), 0, 1);   /* ALLOC_ODT_ENTRY */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_SEQUENCE);
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+}
+
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+/**
+ * With absolute identification ALLOC_ODT refuses ODT's that would
+ * be numbered past the last DTO pid, 0xFB
+ */
+static void Test_AbsolutePids(void)
+{
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+    BENCH_OK(0xD5, 0, BENCH_U16(2));                /* ALLOC_DAQ */
+    BENCH_OK(0xD4, 0, BENCH_U16(0), 0xF0);          /* ALLOC_ODT */
+
+    const uint8* res = BENCH_CMD(0xD4, 0, BENCH_U16(1), 0x0D); /* ALLOC_ODT */
+    TEST_CHECK(res[0] == XCP_PID_ERR && res[1] == XCP_ERR_MEMORY_OVERFLOW);
+
+    BENCH_OK(0xD4, 0, BENCH_U16(1), 0x0C);          /* ALLOC_ODT */
+    BENCH_OK(0xD6);                                 /* FREE_DAQ */
+}
+#endif
+
+#if(XCP_TRANSPORT_CAN == STD_ON && XCP_CAN_TX_IN_FLIGHT)
+/**
+ * A main function hands at most XCP_CAN_TX_IN_FLIGHT frames of a block
+ * upload to CanIf, the rest is sent by the refills of the confirmations
+ * before the next main function.
+ */
+static void Test_InFlight(void)
+{
+    enum { frames = 20 };
+    static const uint8 block[frames * (XCP_CAN_MAX_DTO - 1)];
+
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+    BENCH_OK(0xF6, 0, 0, 0, BENCH_PTR(block));      /* SET_MTA */
+
+    const uint8 upload[] = { 0xF5, sizeof(block) }; /* UPLOAD */
+    uint32 sent = Bench_Tx.frames;
+    Bench_Receive(upload, sizeof(upload));
+    Xcp_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == XCP_CAN_TX_IN_FLIGHT);
+
+    /* nothing is sent until confirmed, then the confirmations refill */
+    Bench_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == frames);
+    TEST_CHECK(Xcp_Session->worker == NULL);
+
+    BENCH_OK(0xFD);                                 /* GET_STATUS */
+}
+#endif
+
+#if(XCP_TRANSPORT_ETH != STD_OFF && XCP_ETH_TX_CONFIRMATION == STD_ON)
+/**
+ * Only one frame is in flight until SoAd confirms it, packets queued
+ * meanwhile are concatenated into the next frame.
+ */
+static void Test_EthConfirm(void)
+{
+    static const uint8 status[] = { 0xFD };         /* GET_STATUS */
+
+    Xcp_Init(&XcpConfig);
+    BENCH_OK(0xFF, 0x00);                           /* CONNECT */
+
+    uint32 sent = Bench_Tx.frames;
+    Bench_Receive(status, sizeof(status));
+    Xcp_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == 1);
+
+    Bench_Receive(status, sizeof(status));
+    Bench_Receive(status, sizeof(status));
+    Xcp_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == 1);
+
+    /* confirms the first frame only after this main function */
+    Bench_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == 1);
+
+    Bench_MainFunction();
+    TEST_CHECK(Bench_Tx.frames - sent == 2);
+    TEST_CHECK(Bench_Tx.len == 2 * (BENCH_HEADER + 6));
+
+    BENCH_OK(0xFD);                                 /* GET_STATUS */
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    Test_MtaRegister();
+    Test_Checksum();
+    Test_Pending();
+    Test_CalPage();
+    Test_DaqAlloc();
+#if(XCP_IDENTIFICATION == XCP_IDENTIFICATION_ABSOLUTE)
+    Test_AbsolutePids();
+#endif
+#if(XCP_TRANSPORT_CAN == STD_ON && XCP_CAN_TX_IN_FLIGHT)
+    Test_InFlight();
+#endif
+#if(XCP_TRANSPORT_ETH != STD_OFF && XCP_ETH_TX_CONFIRMATION == STD_ON)
+    Test_EthConfirm();
+#endif
+
+    printf("%s: tests %s (%u failures)\n", BENCH_CONFIG, Test_Failures ? "FAILED" : "OK", Test_Failures);
+    return Test_Failures != 0;
+}